@@ -0,0 +1,36 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/asio.cc" "CMakeFiles/http_server.dir/src/asio.cc.o" "gcc" "CMakeFiles/http_server.dir/src/asio.cc.o.d"
+  "/root/repo/src/executor.cc" "CMakeFiles/http_server.dir/src/executor.cc.o" "gcc" "CMakeFiles/http_server.dir/src/executor.cc.o.d"
+  "/root/repo/src/headers.cc" "CMakeFiles/http_server.dir/src/headers.cc.o" "gcc" "CMakeFiles/http_server.dir/src/headers.cc.o.d"
+  "/root/repo/src/log.cc" "CMakeFiles/http_server.dir/src/log.cc.o" "gcc" "CMakeFiles/http_server.dir/src/log.cc.o.d"
+  "/root/repo/src/loopback.cc" "CMakeFiles/http_server.dir/src/loopback.cc.o" "gcc" "CMakeFiles/http_server.dir/src/loopback.cc.o.d"
+  "/root/repo/src/mime_type.cc" "CMakeFiles/http_server.dir/src/mime_type.cc.o" "gcc" "CMakeFiles/http_server.dir/src/mime_type.cc.o.d"
+  "/root/repo/src/path_compiler.cc" "CMakeFiles/http_server.dir/src/path_compiler.cc.o" "gcc" "CMakeFiles/http_server.dir/src/path_compiler.cc.o.d"
+  "/root/repo/src/request.cc" "CMakeFiles/http_server.dir/src/request.cc.o" "gcc" "CMakeFiles/http_server.dir/src/request.cc.o.d"
+  "/root/repo/src/request_parser.cc" "CMakeFiles/http_server.dir/src/request_parser.cc.o" "gcc" "CMakeFiles/http_server.dir/src/request_parser.cc.o.d"
+  "/root/repo/src/response.cc" "CMakeFiles/http_server.dir/src/response.cc.o" "gcc" "CMakeFiles/http_server.dir/src/response.cc.o.d"
+  "/root/repo/src/route_tree.cc" "CMakeFiles/http_server.dir/src/route_tree.cc.o" "gcc" "CMakeFiles/http_server.dir/src/route_tree.cc.o.d"
+  "/root/repo/src/router.cc" "CMakeFiles/http_server.dir/src/router.cc.o" "gcc" "CMakeFiles/http_server.dir/src/router.cc.o.d"
+  "/root/repo/src/scan.cc" "CMakeFiles/http_server.dir/src/scan.cc.o" "gcc" "CMakeFiles/http_server.dir/src/scan.cc.o.d"
+  "/root/repo/src/server_common.cc" "CMakeFiles/http_server.dir/src/server_common.cc.o" "gcc" "CMakeFiles/http_server.dir/src/server_common.cc.o.d"
+  "/root/repo/src/stream.cc" "CMakeFiles/http_server.dir/src/stream.cc.o" "gcc" "CMakeFiles/http_server.dir/src/stream.cc.o.d"
+  "/root/repo/src/thread_pool.cc" "CMakeFiles/http_server.dir/src/thread_pool.cc.o" "gcc" "CMakeFiles/http_server.dir/src/thread_pool.cc.o.d"
+  "/root/repo/src/uri.cc" "CMakeFiles/http_server.dir/src/uri.cc.o" "gcc" "CMakeFiles/http_server.dir/src/uri.cc.o.d"
+  "/root/repo/src/uring.cc" "CMakeFiles/http_server.dir/src/uring.cc.o" "gcc" "CMakeFiles/http_server.dir/src/uring.cc.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,45 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/http_server.dir/src/asio.cc.o"
+  "CMakeFiles/http_server.dir/src/asio.cc.o.d"
+  "CMakeFiles/http_server.dir/src/executor.cc.o"
+  "CMakeFiles/http_server.dir/src/executor.cc.o.d"
+  "CMakeFiles/http_server.dir/src/headers.cc.o"
+  "CMakeFiles/http_server.dir/src/headers.cc.o.d"
+  "CMakeFiles/http_server.dir/src/log.cc.o"
+  "CMakeFiles/http_server.dir/src/log.cc.o.d"
+  "CMakeFiles/http_server.dir/src/loopback.cc.o"
+  "CMakeFiles/http_server.dir/src/loopback.cc.o.d"
+  "CMakeFiles/http_server.dir/src/mime_type.cc.o"
+  "CMakeFiles/http_server.dir/src/mime_type.cc.o.d"
+  "CMakeFiles/http_server.dir/src/path_compiler.cc.o"
+  "CMakeFiles/http_server.dir/src/path_compiler.cc.o.d"
+  "CMakeFiles/http_server.dir/src/request.cc.o"
+  "CMakeFiles/http_server.dir/src/request.cc.o.d"
+  "CMakeFiles/http_server.dir/src/request_parser.cc.o"
+  "CMakeFiles/http_server.dir/src/request_parser.cc.o.d"
+  "CMakeFiles/http_server.dir/src/response.cc.o"
+  "CMakeFiles/http_server.dir/src/response.cc.o.d"
+  "CMakeFiles/http_server.dir/src/route_tree.cc.o"
+  "CMakeFiles/http_server.dir/src/route_tree.cc.o.d"
+  "CMakeFiles/http_server.dir/src/router.cc.o"
+  "CMakeFiles/http_server.dir/src/router.cc.o.d"
+  "CMakeFiles/http_server.dir/src/scan.cc.o"
+  "CMakeFiles/http_server.dir/src/scan.cc.o.d"
+  "CMakeFiles/http_server.dir/src/server_common.cc.o"
+  "CMakeFiles/http_server.dir/src/server_common.cc.o.d"
+  "CMakeFiles/http_server.dir/src/stream.cc.o"
+  "CMakeFiles/http_server.dir/src/stream.cc.o.d"
+  "CMakeFiles/http_server.dir/src/thread_pool.cc.o"
+  "CMakeFiles/http_server.dir/src/thread_pool.cc.o.d"
+  "CMakeFiles/http_server.dir/src/uri.cc.o"
+  "CMakeFiles/http_server.dir/src/uri.cc.o.d"
+  "CMakeFiles/http_server.dir/src/uring.cc.o"
+  "CMakeFiles/http_server.dir/src/uring.cc.o.d"
+  "libhttp_server.a"
+  "libhttp_server.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/http_server.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/middleware_files.dir/middleware/files/files.cc.o"
+  "CMakeFiles/middleware_files.dir/middleware/files/files.cc.o.d"
+  "libmiddleware_files.a"
+  "libmiddleware_files.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/middleware_files.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
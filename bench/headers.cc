@@ -0,0 +1,84 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+// Classifies the field names of typical requests, first the way the
+// parser used to, with a lower-case copy given to header_key::make(),
+// then straight from the received bytes, with header_key::classify().
+// Reports millions of names per second.
+//
+//     bench_headers [-n iterations]
+
+#include <web/headers.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	constexpr std::string_view names[] = {
+		// a browser
+		"Host", "Connection", "sec-ch-ua", "sec-ch-ua-mobile", "User-Agent",
+		"sec-ch-ua-platform", "Accept", "Sec-Fetch-Site", "Sec-Fetch-Mode",
+		"Sec-Fetch-Dest", "Referer", "Accept-Encoding", "Accept-Language",
+		"Cookie", "If-None-Match", "If-Modified-Since",
+		// an API client
+		"host", "authorization", "content-type", "content-length", "accept",
+		"user-agent", "x-request-id", "x-forwarded-for", "accept-encoding",
+		// a proxy
+		"HOST", "TRANSFER-ENCODING", "EXPECT", "VIA", "X-FORWARDED-PROTO",
+	};
+
+	template <typename Step>
+	double run(size_t iterations, Step&& step)
+	{
+		auto start = clock_type::now();
+		for (size_t i = 0; i < iterations; ++i) {
+			for (auto name : names)
+				step(name);
+		}
+		auto elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+		return static_cast<double>(std::size(names) * iterations) / elapsed / 1e6;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t iterations = 1000000;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+	}
+
+	size_t mismatches = 0;
+	for (auto name : names) {
+		if (web::header_key::make(std::string { name }).value() != web::header_key::classify(name))
+			++mismatches;
+	}
+
+	// keeps the results alive
+	size_t known = 0;
+	auto by_make = run(iterations, [&](std::string_view name) {
+		if (!web::header_key::make(std::string { name }).extension_header())
+			++known;
+	});
+	auto by_classify = run(iterations, [&](std::string_view name) {
+		if (web::header_key::classify(name) != web::header::extension_header)
+			++known;
+	});
+
+	printf("%-10s %10.1f M names/s\n", "make", by_make);
+	printf("%-10s %10.1f M names/s\n", "classify", by_classify);
+	printf("%zu known\n", known);
+
+	if (mismatches) {
+		fprintf(stderr, "%zu names classified differently\n", mismatches);
+		return 1;
+	}
+}
@@ -0,0 +1,207 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+// Replays a corpus of raw HTTP requests through server::on_connection,
+// over web::loopback streams, on N threads. The corpus is either built
+// in, or read from a file with raw requests, e.g. captured with tcpdump.
+//
+//     bench_loopback [-t threads] [-n rounds] [corpus-file] 2>/dev/null
+//
+// The server still reports each connection on stderr.
+
+#include <web/loopback.h>
+#include <web/log.h>
+#include <web/server.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	constexpr char builtin_corpus[] =
+		"GET /hello/world HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"User-Agent: bench_loopback\r\n"
+		"Accept: */*\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n"
+		"POST /echo HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Content-Type: text/plain\r\n"
+		"Content-Length: 27\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n"
+		"the quick brown fox jumps.\n"
+		"GET /missing?q=1&r=two HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Accept-Language: en-US,en;q=0.5\r\n"
+		"Accept-Encoding: gzip, deflate\r\n"
+		"Cookie: session=0123456789abcdef\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n"
+		"GET /hello/loopback?x=%20y HTTP/1.0\r\n"
+		"Host: localhost\r\n"
+		"\r\n";
+
+	struct samples {
+		std::vector<uint32_t> parse;   // ns, request line and headers
+		std::vector<uint32_t> handle;  // ns, routing, handler and response
+		size_t requests = 0;
+		size_t bytes_out = 0;
+
+		void merge(const samples& rhs)
+		{
+			parse.insert(parse.end(), rhs.parse.begin(), rhs.parse.end());
+			handle.insert(handle.end(), rhs.handle.begin(), rhs.handle.end());
+			requests += rhs.requests;
+			bytes_out += rhs.bytes_out;
+		}
+	};
+
+	// the samples of the thread, which server::on_connection runs on
+	thread_local samples* staged_out = nullptr;
+
+	uint32_t to_ns(std::chrono::nanoseconds ns)
+	{
+		return static_cast<uint32_t>(std::min<long long>(ns.count(), UINT32_MAX));
+	}
+
+	void record_stages(std::chrono::nanoseconds parse, std::chrono::nanoseconds handle)
+	{
+		if (!staged_out)
+			return;
+		staged_out->parse.push_back(to_ns(parse));
+		staged_out->handle.push_back(to_ns(handle));
+		++staged_out->requests;
+	}
+
+	uint32_t percentile(std::vector<uint32_t>& v, double p)
+	{
+		if (v.empty())
+			return 0;
+		auto n = static_cast<size_t>(static_cast<double>(v.size() - 1) * p);
+		std::nth_element(v.begin(), v.begin() + static_cast<ptrdiff_t>(n), v.end());
+		return v[n];
+	}
+
+	void print_stage(const char* name, std::vector<uint32_t>& v)
+	{
+		printf("  %-8s p50 %8.2f us  p90 %8.2f us  p99 %8.2f us\n", name,
+			percentile(v, .50) / 1000.0,
+			percentile(v, .90) / 1000.0,
+			percentile(v, .99) / 1000.0);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t threads = 1;
+	size_t rounds = 20000;
+	std::string corpus = builtin_corpus;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			threads = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			rounds = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+		else {
+			std::ifstream in { argv[i], std::ios::binary };
+			if (!in) {
+				fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[i]);
+				return 1;
+			}
+			corpus.assign(std::istreambuf_iterator<char> { in }, std::istreambuf_iterator<char> { });
+		}
+	}
+
+	::logging::verbose(-1);
+
+	auto root = web::router::make();
+	root->get("/hello/:name", [](const web::request& req, web::response& resp) {
+		resp.print("hello, ").print(*req.find_param("name")).print("\n");
+	});
+	root->add("/echo", [](const web::request& req, web::response& resp) {
+		resp.print(std::string_view { req.payload().data(), req.payload().size() });
+	}, web::method::post);
+
+	web::server srv;
+	srv.set_routes(*root);
+
+	// one replay of the corpus is one connection, closed by the client
+	auto replay = [&](web::loopback& conn, auto&& serve) {
+		conn.reset();
+		conn.push(corpus);
+		conn.close_input();
+		web::stream io { conn };
+		return serve(io);
+	};
+
+	std::vector<samples> results(threads);
+	std::atomic<size_t> connections { 0 };
+
+	// pass 1: server::on_connection, as the backends call it
+	auto start = clock_type::now();
+	{
+		std::vector<std::thread> pool;
+		for (size_t th = 0; th < threads; ++th) {
+			pool.emplace_back([&, th] {
+				web::loopback conn;
+				auto& out = results[th];
+				for (size_t round = 0; round < rounds; ++round) {
+					replay(conn, [&](web::stream& io) { srv.on_connection(io, false); return 0; });
+					out.bytes_out += conn.take_output().size();
+					++connections;
+				}
+			});
+		}
+		for (auto& th : pool)
+			th.join();
+	}
+	auto elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+
+	// pass 2: the same corpus, timed per stage by server::on_connection
+	srv.set_stage_timer(&record_stages);
+	std::vector<samples> staged(threads);
+	{
+		std::vector<std::thread> pool;
+		for (size_t th = 0; th < threads; ++th) {
+			pool.emplace_back([&, th] {
+				web::loopback conn;
+				auto& out = staged[th];
+				out.parse.reserve(rounds * 4);
+				out.handle.reserve(rounds * 4);
+				staged_out = &out;
+				for (size_t round = 0; round < rounds; ++round) {
+					replay(conn, [&](web::stream& io) { srv.on_connection(io, false); return 0; });
+					conn.take_output();
+				}
+				staged_out = nullptr;
+			});
+		}
+		for (auto& th : pool)
+			th.join();
+	}
+
+	samples total;
+	for (auto& s : staged)
+		total.merge(s);
+	for (auto& s : results)
+		total.bytes_out += s.bytes_out;
+
+	auto per_conn = total.requests / (threads * rounds);
+	auto requests = static_cast<double>(connections.load() * per_conn);
+	printf("%zu thread(s), %zu connection(s), %zu request(s) each\n", threads, connections.load(), per_conn);
+	printf("  %.0f req/s, %.1f MiB/s out\n", requests / elapsed,
+		static_cast<double>(total.bytes_out) / elapsed / (1024 * 1024));
+	print_stage("parse", total.parse);
+	print_stage("handle", total.handle);
+}
@@ -0,0 +1,123 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+// Looks paths up among a few hundred routes of a REST-like API, first
+// by trying the regexes of the routes one by one, then with the
+// route_tree, and reports thousands of lookups per second.
+//
+//     bench_router [-n iterations] [-r resources]
+
+#include <web/route.h>
+#include <web/route_tree.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	// eight routes for each resource
+	std::vector<std::string> masks(size_t resources)
+	{
+		std::vector<std::string> out;
+		out.reserve(resources * 8);
+		for (size_t i = 0; i < resources; ++i) {
+			auto base = "/api/v1/resource" + std::to_string(i);
+			out.push_back(base);
+			out.push_back(base + "/:id");
+			out.push_back(base + "/:id/details");
+			out.push_back(base + "/:id/items/:item");
+			out.push_back(base + "/:id(\\d+)/history");
+			out.push_back(base + "/search");
+			out.push_back(base + "/export/*");
+			out.push_back(base + "/:id/items");
+		}
+		return out;
+	}
+
+	template <typename Find>
+	double run(const std::vector<std::string>& paths, size_t iterations, Find&& find)
+	{
+		auto start = clock_type::now();
+		for (size_t i = 0; i < iterations; ++i) {
+			for (auto& path : paths)
+				find(path);
+		}
+		auto elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+		return static_cast<double>(paths.size() * iterations) / elapsed / 1e3;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t iterations = 200;
+	size_t resources = 100;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			iterations = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			resources = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+	}
+
+	std::vector<std::shared_ptr<web::route>> routes;
+	web::route_tree tree;
+	for (auto& mask : masks(resources)) {
+		routes.push_back(std::make_shared<web::route>(mask, web::endpoint_type { }, web::COMPILE_DEFAULT));
+		tree.add(routes.back());
+	}
+
+	auto last = std::to_string(resources - 1);
+	auto middle = std::to_string(resources / 2);
+	std::vector<std::string> paths = {
+		"/api/v1/resource0/42",
+		"/api/v1/resource" + middle + "/42/items/7",
+		"/api/v1/resource" + middle + "/42/history",
+		"/api/v1/resource" + last + "/search",
+		"/api/v1/resource" + last + "/export/2024/01/report.csv",
+		"/api/v1/missing/42", // a miss
+	};
+
+	std::pmr::vector<web::param> params;
+	size_t mismatches = 0;
+	for (auto& path : paths) {
+		std::shared_ptr<web::route> linear;
+		for (auto& route : routes) {
+			if (route->matcher().matches(path, params)) {
+				linear = route;
+				break;
+			}
+		}
+		if (tree.find(path, params) != linear)
+			++mismatches;
+	}
+
+	size_t found = 0;
+	auto by_regex = run(paths, std::max<size_t>(1, iterations / 20), [&](const std::string& path) {
+		for (auto& route : routes) {
+			if (route->matcher().matches(path, params)) {
+				++found;
+				break;
+			}
+		}
+	});
+	auto by_tree = run(paths, iterations, [&](const std::string& path) {
+		if (tree.find(path, params))
+			++found;
+	});
+
+	printf("%zu routes, %zu of them matched by regex in the tree\n", routes.size(), tree.regex_count());
+	printf("%-10s %10.1f k lookups/s\n", "regex", by_regex);
+	printf("%-10s %10.1f k lookups/s\n", "tree", by_tree);
+	printf("%zu found\n", found);
+
+	if (mismatches) {
+		fprintf(stderr, "%zu paths found different routes\n", mismatches);
+		return 1;
+	}
+}
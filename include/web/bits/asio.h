@@ -13,12 +13,16 @@
 #pragma warning (disable:4834)
 #endif
 #include <boost/asio.hpp>
+#include <boost/context/fiber.hpp>
+#include <boost/context/pooled_fixedsize_stack.hpp>
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
 #include <unordered_set>
 #include <web/delegate.h>
+#include <web/executor.h>
+#include <web/thread_pool.h>
 #include <web/log.h>
 #include <web/request.h>
 #include <web/response.h>
@@ -27,19 +31,118 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <optional>
+#include <chrono>
 
 namespace web { namespace asio {
 	using namespace boost::asio;
 	using boost::system::error_code;
 
+	// Entry points into the server. on_overload answers a request, which
+	// could not be queued for the handler workers.
+	struct callbacks {
+		delegate<void(stream&, bool)> on_connection;
+		delegate<bool(stream&, request_parser&, bool)> on_request;
+		delegate<bool(stream&, request_parser&, bool)> on_overload;
+		// answers Expect: 100-continue, before the content arrives; false
+		// for a final response
+		delegate<bool(stream&, request_parser&, bool)> on_expect;
+		// answers a head, which grew past the limits
+		delegate<void(stream&, request_parser&, parsing)> on_rejected;
+		// the most content any of the routes takes
+		delegate<uint64_t()> max_content;
+		delegate<const request_limits&()> limits;
+	};
+
+	// Limits on a single stage of a connection; zero turns a limit off.
+	struct timeouts {
+		std::chrono::milliseconds idle { std::chrono::seconds { 60 } };  // for the first byte of a request
+		std::chrono::milliseconds head { std::chrono::seconds { 60 } };  // from the first byte to the end of the fields
+		std::chrono::milliseconds body { std::chrono::seconds { 60 } };  // between two reads of the content
+		std::chrono::milliseconds write { std::chrono::seconds { 60 } }; // between two writes making progress
+	};
+
 	class connection_manager;
+	class timer_wheel;
 	class connection : public std::enable_shared_from_this<connection> {
+		friend class timer_wheel;
+		// guarded by the wheel
+		uint64_t m_deadline = 0;    // in wheel ticks, 0 when disarmed
+		uint64_t m_wheel_entry = 0; // tick of the live wheel entry, if any
+
+		io_stage m_stage = io_stage::idle;
+
+		void arm(std::chrono::milliseconds timeout);
+		void disarm();
+	protected:
+		connection_manager& m_connection_manager;
+	public:
+		connection(const connection&) = delete;
+		connection& operator=(const connection&) = delete;
+		explicit connection(connection_manager& manager);
+		virtual ~connection();
+
+		virtual ip::tcp::socket& socket() = 0;
+		virtual void start() = 0;
+		virtual void stop() = 0;
+
+		void shutdown();
+		void expire();
+
+		// move the deadline along with the stage of the connection
+		void stage(io_stage next);
+		void received();
+		void writing();
+		void written();
+	};
+
+	// The deadlines of all the connections of a shard, kept on a single
+	// timer. Moving a deadline does not touch the wheel, if the entry
+	// already there comes up earlier; stale entries are dropped, when
+	// their slot comes up.
+	class timer_wheel {
+	public:
+		using clock = std::chrono::steady_clock;
+		static constexpr std::chrono::milliseconds resolution { 100 };
+		static constexpr size_t slots = 512;
+	private:
+		struct entry {
+			std::weak_ptr<connection> conn;
+			uint64_t tick;
+		};
+
+		std::mutex m_mtx;
+		io_service::strand& m_strand;
+		steady_timer m_timer;
+		clock::time_point m_start;
+		uint64_t m_current = 0;
+		std::array<std::vector<entry>, slots> m_slots;
+		bool m_stopped = false;
+
+		uint64_t now() const;
+		void schedule();
+		void tick();
+	public:
+		timer_wheel(io_service& io, io_service::strand& strand);
+		void start();
+		void stop(); // from the strand
+		void arm(connection& conn, std::chrono::milliseconds timeout);
+		void disarm(connection& conn);
+	};
+
+	class threaded_connection : public connection {
+		// The handler thread blocks on m_cv, while its reads and writes,
+		// and close() from stop(), run on the io threads through m_strand.
 		class asio_stream : public stream::impl {
 			ip::tcp::socket m_socket;
-			connection* m_parent;
+			io_service::strand m_strand;
+			threaded_connection* m_parent;
 			std::mutex m_mtx;
 			std::condition_variable m_cv;
-			bool socket_aborting = false;
+			std::atomic<bool> socket_aborting { false };
+			endpoint_t m_local;
+			endpoint_t m_remote;
 
 			enum {
 				succeeded,
@@ -49,13 +152,15 @@ namespace web { namespace asio {
 			};
 
 			struct RX {
-				const void* data = nullptr;
+				const buffer_view* buffers = nullptr;
+				size_t count = 0;
 				size_t transferred = 0;
 				int status = running;
 			};
 
 			struct TX {
-				std::array<char, 8192> data;
+				void* data = nullptr;
+				size_t size = 0;
 				size_t transferred = 0;
 				int status = running;
 			};
@@ -63,8 +168,9 @@ namespace web { namespace asio {
 			void write_data(RX& rx, unsigned tid, unsigned conn);
 			void read_data(TX& tx, unsigned tid, unsigned conn);
 		public:
-			asio_stream(io_service& io, connection* parent)
+			asio_stream(io_service& io, threaded_connection* parent)
 				: m_socket { io }
+				, m_strand { io }
 				, m_parent { parent }
 			{
 				LOG_DBG2() << "asio_stream::asio_stream(this:" << this << ")";
@@ -75,54 +181,253 @@ namespace web { namespace asio {
 
 			void shutdown(stream*) override;
 			bool overflow(stream* src, const void* data, size_t size, unsigned conn) override;
-			bool underflow(stream* src, unsigned conn) override;
+			size_t read_some(stream* src, void* data, size_t size, unsigned conn) override;
+			bool writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn) override;
+			bool can_send_file(stream*) override;
+			bool send_file(stream* src, int fd, uint64_t offset, uint64_t length, unsigned conn) override;
+			void stage(stream*, io_stage next) override;
 			bool is_open(stream*) override;
 			endpoint_t remote_endpoint(stream*) override;
 			endpoint_t local_endpoint(stream*) override;
 
 			ip::tcp::socket& socket() { return m_socket; }
+			// before the handler thread takes over the socket
+			void opened();
 			void close();
 		};
 
+		io_service& m_io;
+		thread_pool& m_threads;
 		asio_stream m_stream;
-
-		std::thread m_th;
-		connection_manager& m_connection_manager;
-		std::array<char, 8192> m_buffer;
+		std::optional<executor_work_guard<io_service::executor_type>> m_work;
 
 		void handle(bool secure);
 	public:
-		connection(const connection&) = delete;
-		connection& operator=(const connection&) = delete;
-		explicit connection(io_service& io, connection_manager& manager);
-		~connection();
+		explicit threaded_connection(io_service& io, connection_manager& manager, thread_pool& threads);
+		~threaded_connection();
 
-		ip::tcp::socket& socket() { return m_stream.socket(); }
+		ip::tcp::socket& socket() override { return m_stream.socket(); }
 
-		void start();
-		void stop();
+		void start() override;
+		void stop() override;
+	};
 
-		void shutdown();
+	class async_connection : public connection {
+		// Serves a single, already received request to server::on_request
+		// and collects everything written back into m_output. Files are
+		// not copied, only their ranges are kept in m_files, until write()
+		// gets to them.
+		class buffered_stream : public stream::impl {
+			async_connection* m_parent;
+			const char* m_body;
+			size_t m_body_length;
+			bool m_shut = false;
+		public:
+			buffered_stream(async_connection* parent, const char* body, size_t body_length)
+				: m_parent { parent }
+				, m_body { body }
+				, m_body_length { body_length }
+			{
+			}
+
+			void shutdown(stream*) override { m_shut = true; }
+			bool overflow(stream* src, const void* data, size_t size, unsigned conn) override;
+			size_t read_some(stream* src, void* data, size_t size, unsigned conn) override;
+			bool writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn) override;
+			bool can_send_file(stream*) override;
+			bool send_file(stream* src, int fd, uint64_t offset, uint64_t length, unsigned conn) override;
+			bool is_open(stream*) override { return !m_shut; }
+			endpoint_t remote_endpoint(stream*) override { return m_parent->m_remote; }
+			endpoint_t local_endpoint(stream*) override { return m_parent->m_local; }
+
+			bool was_shut() const { return m_shut; }
+		};
+
+		ip::tcp::socket m_socket;
+		io_service::strand m_strand;
+		executor* m_executor;
+		endpoint_t m_local;
+		endpoint_t m_remote;
+
+		std::vector<char> m_input;
+		struct file_segment {
+			int fd;          // owned, closed after sending
+			uint64_t offset;
+			uint64_t length;
+			size_t position; // of the file inside m_output
+		};
+
+		std::vector<char> m_output;
+		std::vector<file_segment> m_files;
+		size_t m_written = 0;
+		request_arena m_arena;
+		base_authority m_base;
+		request_parser m_parser;
+		size_t m_head_length = 0;
+		size_t m_body_length = 0; // as received, i.e. with the chunks' framing
+		bool m_chunked = false;
+		chunked_decoder m_chunks;
+		uint64_t m_decoded = 0; // of the chunks received so far
+		bool m_expects = false;
+		bool m_too_large = false; // over max_content(), answered unread
+		unsigned m_conn_no = 0;
+		size_t m_pipelined = 0; // responses waiting for the next write
+		bool m_keep_alive = true;
+
+		void read_some();
+		parsing parse_head();
+		bool body_received();
+		void answer_expect();
+		bool ask_expect(bool overloaded);
+		void expect_answered(bool go_on);
+		void reject(parsing reason);
+		bool process();
+		void serve();
+		void run_request(bool overloaded);
+		void finish_request();
+		void write();
+		void write_file();
+		void next();
+	public:
+		explicit async_connection(io_service& io, connection_manager& manager, executor* workers);
+		~async_connection();
+
+		ip::tcp::socket& socket() override { return m_socket; }
+
+		void start() override;
+		void stop() override;
+	};
+
+	// Stacks for the coroutine connections. Coroutines are started from
+	// the acceptor, but finish on any of the io threads, hence the lock.
+	class stack_pool {
+		std::mutex m_mtx;
+		boost::context::pooled_fixedsize_stack m_stacks;
+	public:
+		struct allocator {
+			stack_pool* pool;
+			boost::context::stack_context allocate() { return pool->allocate(); }
+			void deallocate(boost::context::stack_context& sctx) noexcept { pool->deallocate(sctx); }
+		};
+
+		explicit stack_pool(size_t stack_size) : m_stacks { stack_size } { }
+		boost::context::stack_context allocate();
+		void deallocate(boost::context::stack_context& sctx) noexcept;
+		allocator get_allocator() { return { this }; }
+	};
+
+	class coroutine_connection : public connection {
+		// Same blocking contract as the asio_stream, except waiting for
+		// the socket suspends the coroutine instead of the whole thread.
+		class fiber_stream : public stream::impl {
+			coroutine_connection* m_parent;
+		public:
+			explicit fiber_stream(coroutine_connection* parent) : m_parent { parent } { }
+
+			void shutdown(stream*) override;
+			bool overflow(stream* src, const void* data, size_t size, unsigned conn) override;
+			size_t read_some(stream* src, void* data, size_t size, unsigned conn) override;
+			bool writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn) override;
+			bool can_send_file(stream*) override;
+			bool send_file(stream* src, int fd, uint64_t offset, uint64_t length, unsigned conn) override;
+			void stage(stream*, io_stage next) override;
+			bool is_open(stream*) override;
+			endpoint_t remote_endpoint(stream*) override;
+			endpoint_t local_endpoint(stream*) override;
+		};
+
+		ip::tcp::socket m_socket;
+		io_service::strand m_strand;
+		stack_pool& m_stacks;
+		fiber_stream m_stream;
+		boost::context::fiber m_fiber;
+		boost::context::fiber m_caller;
+
+		void resume(); // from the strand
+		void yield();  // from inside the coroutine
+	public:
+		explicit coroutine_connection(io_service& io, connection_manager& manager, stack_pool& stacks);
+		~coroutine_connection();
+
+		ip::tcp::socket& socket() override { return m_socket; }
+
+		void start() override;
+		void stop() override;
+	};
+
+	struct shard_stats {
+		size_t connections{}; // currently open
+		size_t accepted{};    // since the shard started listening
+		size_t timed_out{};   // closed by one of the timeouts
 	};
 
 	class connection_manager {
+		mutable std::mutex m_mtx;
 		std::unordered_set<std::shared_ptr<connection>> m_connections;
-		delegate<void(stream&, bool)> m_onconnection;
+		size_t m_accepted = 0;
+		size_t m_timed_out = 0;
+		callbacks m_callbacks;
+		timer_wheel& m_wheel;
+		asio::timeouts m_timeouts;
+		size_t m_pipeline_depth;
 	public:
 		connection_manager(const connection_manager&) = delete;
 		connection_manager& operator=(const connection_manager&) = delete;
-		connection_manager(delegate<void(web::stream&, bool)> onconnection)
-			: m_onconnection(std::move(onconnection))
+		connection_manager(const callbacks& cb, timer_wheel& wheel, const asio::timeouts& limits, size_t pipeline_depth)
+			: m_callbacks(cb)
+			, m_wheel(wheel)
+			, m_timeouts(limits)
+			, m_pipeline_depth(pipeline_depth)
 		{
 		}
 
 		void start(const std::shared_ptr<connection>& c);
 		void stop(const std::shared_ptr<connection>& c);
+		void expire(const std::shared_ptr<connection>& c);
 		void stop_all();
+		shard_stats stats() const;
+		timer_wheel& wheel() { return m_wheel; }
+		const asio::timeouts& timeouts() const { return m_timeouts; }
+		size_t pipeline_depth() const { return m_pipeline_depth; }
 		void on_connection(stream& io, bool secure)
 		{
-			m_onconnection(io, secure);
+			m_callbacks.on_connection(io, secure);
+		}
+		bool on_request(stream& io, request_parser& parser, bool secure)
+		{
+			return m_callbacks.on_request(io, parser, secure);
+		}
+		bool on_overload(stream& io, request_parser& parser, bool secure)
+		{
+			return m_callbacks.on_overload(io, parser, secure);
 		}
+		bool on_expect(stream& io, request_parser& parser, bool secure)
+		{
+			return m_callbacks.on_expect(io, parser, secure);
+		}
+		void on_rejected(stream& io, request_parser& parser, parsing reason)
+		{
+			m_callbacks.on_rejected(io, parser, reason);
+		}
+		uint64_t max_content()
+		{
+			return m_callbacks.max_content();
+		}
+		const request_limits& limits()
+		{
+			return m_callbacks.limits();
+		}
+	};
+
+	enum class execution {
+		threaded, // a thread per accepted socket, blocking on every read and write
+		async,    // a read -> parse -> dispatch -> write state machine run on the io threads
+		coroutine // the blocking handler loop, run on a stackful coroutine over the io threads
+	};
+
+	enum class backend {
+		asio,    // the execution set on the server, over boost::asio
+		io_uring // Linux io_uring rings, one per thread, serving coroutines
 	};
 
 	struct endpoint {
@@ -130,24 +435,86 @@ namespace web { namespace asio {
 		unsigned short port{};
 	};
 
-	class service {
+	// An acceptor with its own io_service and connections. The service
+	// either runs one shard on a pool of threads, or - when sharded - one
+	// single-threaded shard per core, with the kernel balancing accepted
+	// sockets between the SO_REUSEPORT acceptors.
+	class shard {
+		std::unique_ptr<stack_pool> m_stacks;
 		io_service m_service;
-		signal_set m_signals;
+		io_service::strand m_strand;
 		ip::tcp::acceptor m_acceptor;
+		timer_wheel m_wheel;
 		connection_manager m_manager;
-		std::string m_server;
+		asio::execution m_execution;
+		executor* m_executor;
+		thread_pool* m_threads;
 
 		void next_accept();
+		std::shared_ptr<connection> make_connection();
+	public:
+		shard(asio::execution mode, size_t stack_size, executor* workers, thread_pool* threads, const asio::timeouts& limits, size_t pipeline_depth, const callbacks& cb);
+		~shard();
+
+		unsigned short listen(const ip::tcp::endpoint& endpoint, bool reuse_port);
+		void stop();
+		io_service& get_io_service() { return m_service; }
+		shard_stats stats() const { return m_manager.stats(); }
+		void run() { m_service.run(); }
+	};
+
+	class service {
+		callbacks m_callbacks;
+		std::vector<std::unique_ptr<shard>> m_shards;
+		// after the shards: queued jobs post back to their strands
+		std::unique_ptr<executor> m_executor;
+		std::unique_ptr<thread_pool> m_connection_threads;
+		std::unique_ptr<signal_set> m_signals;
+		std::string m_server;
+		asio::timeouts m_timeouts;
+		size_t m_pipeline_depth = 16;
+		asio::execution m_execution = asio::execution::threaded;
+		size_t m_threads = 0;
+		size_t m_stack_size = 0;
+		size_t m_max_threads = 0;
+		size_t m_workers = 0;
+		size_t m_queue_depth = 0;
+		bool m_sharded = false;
 	public:
-		service(delegate<void(stream&, bool)> onconnection);
+		service(const callbacks& cb);
 		~service();
 		endpoint setup(unsigned short port);
 		void server(const std::string& value) { m_server = value; }
 		const std::string& server() const { return m_server; }
-
-		void run()
+		void execution(asio::execution value) { m_execution = value; }
+		asio::execution execution() const { return m_execution; }
+		// number of threads calling io_service::run(); 0 means one per core
+		void threads(size_t value) { m_threads = value; }
+		size_t threads() const;
+		// coroutine or connection thread stack; 0 means 256 KiB for
+		// coroutines and the platform default for threads
+		void stack_size(size_t value) { m_stack_size = value; }
+		size_t stack_size() const { return m_stack_size; }
+		// cap on connection threads in the threaded execution; 0 means no cap
+		void max_threads(size_t value) { m_max_threads = value; }
+		size_t max_threads() const { return m_max_threads; }
+		// one shard per thread, each pinned to its own core
+		void sharded(bool value) { m_sharded = value; }
+		bool sharded() const { return m_sharded; }
+		// handler threads for the async execution; 0 runs handlers on the io threads
+		void workers(size_t count, size_t queue_depth)
 		{
-			m_service.run();
+			m_workers = count;
+			m_queue_depth = queue_depth;
 		}
+
+		void timeouts(const asio::timeouts& value) { m_timeouts = value; }
+		const asio::timeouts& timeouts() const { return m_timeouts; }
+		// most responses to pipelined requests gathered into one write
+		void pipeline_depth(size_t value) { m_pipeline_depth = value ? value : 1; }
+		size_t pipeline_depth() const { return m_pipeline_depth; }
+
+		std::vector<shard_stats> stats() const;
+		void run();
 	};
 }} // web::asio
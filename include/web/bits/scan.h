@@ -0,0 +1,55 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace web { namespace scan {
+	// Instruction sets of the scanning kernels. The best one the CPU
+	// supports is picked at the first call.
+	enum class isa {
+		scalar,
+		sse2,
+		avx2
+	};
+
+	isa supported();
+	isa current();
+	// for benchmarks; anything above supported() is ignored
+	void use(isa level);
+	const char* name(isa level);
+
+	struct kernels {
+		const char* (*find)(const char* cur, const char* end, char c);
+		const char* (*find_non_token)(const char* cur, const char* end);
+		const char* (*find_unsafe)(const char* cur, const char* end);
+	};
+
+	const kernels& active();
+
+	// the first c in [cur, end), or end
+	inline const char* find(const char* cur, const char* end, char c)
+	{
+		return active().find(cur, end, c);
+	}
+
+	// the first byte in [cur, end), which is not a tchar from RFC 7230,
+	// e.g. the colon after a field name, or end
+	inline const char* find_non_token(const char* cur, const char* end)
+	{
+		return active().find_non_token(cur, end);
+	}
+
+	// the first byte in [cur, end), which is not unreserved in RFC 3986,
+	// i.e. not a letter, a digit, nor one of "-._~", or end
+	inline const char* find_unsafe(const char* cur, const char* end)
+	{
+		return active().find_unsafe(cur, end);
+	}
+
+	bool is_token(char c);
+	bool is_unreserved(char c);
+}} // web::scan
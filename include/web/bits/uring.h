@@ -0,0 +1,226 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#pragma once
+
+#include <web/bits/asio.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+
+namespace web { namespace uring {
+	// The submission and completion queues, shared with the kernel
+	// through io_uring_setup(2)/io_uring_enter(2), without liburing.
+	class ring {
+		int m_fd = -1;
+		void* m_sq_ring = nullptr;
+		size_t m_sq_ring_size = 0;
+		void* m_cq_ring = nullptr;
+		size_t m_cq_ring_size = 0;
+		io_uring_sqe* m_sqes = nullptr;
+		size_t m_sqes_size = 0;
+
+		unsigned* m_sq_head = nullptr;
+		unsigned* m_sq_tail = nullptr;
+		unsigned* m_sq_array = nullptr;
+		unsigned m_sq_mask = 0;
+		unsigned m_sq_entries = 0;
+		unsigned m_sq_local = 0; // prepared, but not yet published
+
+		unsigned* m_cq_head = nullptr;
+		unsigned* m_cq_tail = nullptr;
+		io_uring_cqe* m_cqes = nullptr;
+		unsigned m_cq_mask = 0;
+
+		void release();
+	public:
+		ring(const ring&) = delete;
+		ring& operator=(const ring&) = delete;
+		explicit ring(unsigned entries);
+		~ring();
+
+		int fd() const { return m_fd; }
+		// a zeroed entry; when the queue is full, it is submitted first
+		io_uring_sqe* next_sqe();
+		void submit(unsigned wait_for);
+
+		template <typename Handler>
+		void drain(Handler&& handler)
+		{
+			auto head = *m_cq_head;
+			while (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+				// copied, the slot goes back to the kernel before the handler runs
+				auto cqe = m_cqes[head & m_cq_mask];
+				++head;
+				__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+				handler(cqe);
+			}
+		}
+	};
+
+	// Receive buffers, which the kernel picks for each recv.
+	class buffer_ring {
+		ring& m_ring;
+		io_uring_buf_ring* m_bufs = nullptr;
+		size_t m_bufs_size = 0;
+		std::unique_ptr<char[]> m_data;
+		size_t m_buffer_size;
+		unsigned m_entries;
+		uint16_t m_tail = 0;
+		unsigned m_in_use = 0;
+
+		void publish(uint16_t bid);
+	public:
+		static constexpr uint16_t group = 0;
+
+		buffer_ring(const buffer_ring&) = delete;
+		buffer_ring& operator=(const buffer_ring&) = delete;
+		buffer_ring(ring& owner, unsigned entries, size_t buffer_size);
+		~buffer_ring();
+
+		const char* data(uint16_t bid) const { return m_data.get() + bid * m_buffer_size; }
+		void taken() { ++m_in_use; } // by a completion
+		void recycle(uint16_t bid);
+		bool available() const { return m_in_use < m_entries; }
+	};
+
+	class worker;
+
+	// A socket served by the blocking handler loop, run on a coroutine.
+	// Reading takes the chunk the last recv delivered and waiting suspends
+	// the coroutine, until the ring completes something. The recv is armed
+	// by read_some() alone, so a client sending more than the handler reads
+	// holds a single buffer of the pool, not as many as the kernel fills.
+	class connection : public stream::impl {
+		struct chunk {
+			uint16_t bid;
+			uint32_t offset;
+			uint32_t length;
+		};
+
+		worker& m_worker;
+		int m_fd;
+		endpoint_t m_local;
+		endpoint_t m_remote;
+		boost::context::fiber m_fiber;
+		boost::context::fiber m_caller;
+
+		std::deque<chunk> m_received;
+		bool m_recv_armed = false;
+		bool m_recv_ended = false; // EOF or an error, nothing more will come
+		bool m_reading = false;
+		bool m_sending = false;
+		int m_send_result = 0;
+		bool m_shut = false;
+		bool m_done = false;
+
+		io_stage m_stage = io_stage::idle;
+		asio::timer_wheel::clock::time_point m_deadline { };
+
+		void arm_recv();
+		void yield() { m_caller = std::move(m_caller).resume(); }
+		void arm(std::chrono::milliseconds timeout);
+		void received();
+		void writing();
+		void written();
+	public:
+		connection(worker& owner, int fd);
+		~connection();
+
+		int fd() const { return m_fd; }
+		bool done() const { return m_done; }
+		bool recv_armed() const { return m_recv_armed; }
+		bool starved() const { return !m_recv_armed && !m_recv_ended && m_reading; }
+		bool expired(asio::timer_wheel::clock::time_point now) const;
+
+		void start(asio::stack_pool& stacks);
+		void resume() { m_fiber = std::move(m_fiber).resume(); }
+		void on_recv(const io_uring_cqe& cqe);
+		void on_send(const io_uring_cqe& cqe);
+		void release_buffers();
+		void rearm() { arm_recv(); }
+		void abort(); // the coroutine sees the socket closing, even while starved
+
+		void shutdown(stream*) override;
+		bool overflow(stream* src, const void* data, size_t size, unsigned conn) override;
+		size_t read_some(stream* src, void* data, size_t size, unsigned conn) override;
+		bool writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn) override;
+		void stage(stream*, io_stage next) override;
+		bool is_open(stream*) override { return !m_shut; }
+		endpoint_t remote_endpoint(stream*) override { return m_remote; }
+		endpoint_t local_endpoint(stream*) override { return m_local; }
+	};
+
+	class service;
+
+	// A ring, its listening socket and its connections, run by a single
+	// thread. Listening sockets share the port through SO_REUSEPORT.
+	class worker {
+		friend class connection;
+		enum tag : uint64_t {
+			accept_tag = 1,
+			recv_tag,
+			send_tag,
+			tick_tag,
+			ignore_tag
+		};
+		static constexpr uint64_t tag_mask = 7;
+
+		service& m_service;
+		ring m_ring;
+		buffer_ring m_buffers;
+		asio::stack_pool m_stacks;
+		int m_listener = -1;
+		__kernel_timespec m_tick { };
+		std::unordered_map<connection*, std::unique_ptr<connection>> m_connections;
+		std::vector<connection*> m_starved; // out of buffers, while reading
+		bool m_accept_armed = false;
+		bool m_closing = false;
+
+		std::atomic<size_t> m_open { 0 };
+		std::atomic<size_t> m_accepted { 0 };
+		std::atomic<size_t> m_timed_out { 0 };
+
+		static uint64_t user_data(const void* ptr, tag kind);
+		void arm_accept();
+		void arm_tick();
+		void on_accept(const io_uring_cqe& cqe);
+		void on_tick();
+		void dispatch(const io_uring_cqe& cqe);
+		void abort(connection* conn);
+		void finish(connection* conn);
+		void close_all();
+	public:
+		worker(service& owner, size_t stack_size);
+		~worker();
+
+		unsigned short listen(unsigned short port);
+		void run();
+		asio::shard_stats stats() const { return { m_open, m_accepted, m_timed_out }; }
+	};
+
+	class service {
+		friend class worker;
+		friend class connection;
+		asio::callbacks m_callbacks;
+		asio::timeouts m_timeouts;
+		std::string m_host;
+		size_t m_threads;
+		size_t m_stack_size;
+		std::vector<std::unique_ptr<worker>> m_workers;
+		std::atomic<bool> m_stopping { false };
+	public:
+		service(const asio::callbacks& cb, size_t threads, size_t stack_size, const asio::timeouts& limits);
+		~service();
+
+		// throws std::system_error, if the kernel has no (usable) io_uring
+		asio::endpoint setup(unsigned short port);
+		void run();
+		std::vector<asio::shard_stats> stats() const;
+		void stop() { m_stopping = true; }
+	};
+}} // web::uring
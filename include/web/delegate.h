@@ -16,6 +16,7 @@
 #include <memory>
 #include <utility>
 #include <functional>
+#include <stdexcept>
 
 template <typename T> class delegate;
 
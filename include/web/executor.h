@@ -0,0 +1,43 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace web {
+	// A fixed number of workers fed through a bounded, multi-producer,
+	// multi-consumer queue. Posting never blocks; once the queue is full,
+	// post() refuses the job and the caller is expected to shed the load.
+	class executor {
+	public:
+		using job = std::function<void()>;
+
+		executor(size_t workers, size_t capacity);
+		~executor();
+		executor(const executor&) = delete;
+		executor& operator=(const executor&) = delete;
+
+		bool post(job&& task);
+		void stop();
+
+		size_t capacity() const { return m_queue.size(); }
+		size_t pending() const;
+	private:
+		mutable std::mutex m_mtx;
+		std::condition_variable m_cv;
+		std::vector<job> m_queue;
+		size_t m_head = 0;
+		size_t m_count = 0;
+		bool m_stopped = false;
+		std::vector<std::thread> m_workers;
+
+		void work();
+	};
+}
@@ -5,7 +5,11 @@
 
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
@@ -73,6 +77,9 @@ namespace web {
 		Set_Cookie
 	};
 
+	// the size of the tables indexed by a header
+	constexpr size_t header_count = static_cast<size_t>(header::Set_Cookie) + 1;
+
 	class header_key {
 		header m_header = header::empty;
 		std::string m_extension;
@@ -90,6 +97,11 @@ namespace web {
 		const std::string& extension() const { return m_extension; }
 
 		static header_key make(std::string);
+		// The known header, which the name stands for, regardless of the
+		// case of its letters, or extension_header; no copies are made.
+		static header classify(std::string_view name) noexcept;
+		// the name, as received, stands for this key
+		bool matches(std::string_view name) const;
 		static const char* name(header);
 		const char* name() const;
 
@@ -126,50 +138,89 @@ namespace std {
 			noexcept(hash<std::string>{}(std::string { }))
 			)
 		{
-			if (key == web::header::extension_header)
-				return hash<web::header>{}(key.value());
-			return hash<std::string>{}(key.extension());
+			if (key.extension_header())
+				return hash<std::string>{}(key.extension());
+			return hash<web::header>{}(key.value());
 		}
 	};
 }
 
 namespace web {
+	// The headers of a response, in the order they were added, which is
+	// the order they are sent in. The first value of a known header is
+	// found through a table indexed by the header; the extension headers,
+	// which are few, are looked for in the fields themselves.
 	class headers {
-		std::unordered_map<header_key, std::vector<std::string>> m_headers;
 	public:
-		void add(const header_key& key, const std::string& value)
-		{
-			m_headers[key].emplace_back(value);
-		}
-		void add(const header_key& key, std::string&& value)
-		{
-			m_headers[key].emplace_back(std::move(value));
-		}
-		void erase(const header_key& key)
+		struct field {
+			header_key key;
+			std::pmr::string value;
+		};
+
+		headers() = default;
+		explicit headers(std::pmr::memory_resource* arena) : m_fields { arena } { }
+
+		void add(const header_key& key, std::string_view value);
+		void erase(const header_key& key);
+
+		auto empty() const { return m_fields.empty(); }
+		auto size() const { return m_fields.size(); }
+		auto begin() const { return m_fields.begin(); }
+		auto end() const { return m_fields.end(); }
+		void clear()
 		{
-			m_headers.erase(key);
+			m_fields.clear();
+			m_first.fill(0);
 		}
 
-		auto empty() const { return m_headers.empty(); }
-		auto size() const { return m_headers.size(); }
-		auto find(const header_key& key) const { return m_headers.find(key); }
-		auto begin() const { return m_headers.begin(); }
-		auto end() const { return m_headers.end(); }
-		void clear() { m_headers.clear(); }
+		bool has(const header_key& key) const { return find_front(key) != nullptr; }
+		const std::pmr::string* find_front(const header_key& key) const;
+	private:
+		std::pmr::vector<field> m_fields;
+		// one past the position of the first field of each known header,
+		// zero for the headers not added
+		std::array<uint32_t, header_count> m_first { };
+	};
+
+	// The fields of a received request. Names and values are views into
+	// a copy of the request head, or - for folded values - into strings
+	// unfolded on the request's arena; both live as long as the request.
+	class request_headers {
+	public:
+		struct field {
+			header key; // extension_header for names outside the enum
+			std::string_view name; // as received
+			std::string_view value;
+		};
 
-		bool has(const header_key& key) const
+		request_headers() = default;
+		explicit request_headers(std::pmr::memory_resource* arena) : m_fields { arena } { }
+
+		void add(header key, std::string_view name, std::string_view value)
 		{
-			auto it = find(key);
-			return it != end() && !it->second.empty();
+			m_fields.push_back({ key, name, value });
+			auto& first = m_first[static_cast<size_t>(key)];
+			if (!first)
+				first = static_cast<uint32_t>(m_fields.size());
 		}
-
-		const std::string* find_front(const header_key& key) const
+		void clear()
 		{
-			auto it = find(key);
-			if (it != end() && !it->second.empty())
-				return &it->second.front();
-			return nullptr;
+			m_fields.clear();
+			m_first.fill(0);
 		}
+		void reserve(size_t count) { m_fields.reserve(count); }
+
+		auto empty() const { return m_fields.empty(); }
+		auto size() const { return m_fields.size(); }
+		auto begin() const { return m_fields.begin(); }
+		auto end() const { return m_fields.end(); }
+
+		bool has(const header_key& key) const { return find_front(key) != nullptr; }
+		const std::string_view* find_front(const header_key& key) const;
+	private:
+		std::pmr::vector<field> m_fields;
+		// as in headers; the extension headers are always looked for
+		std::array<uint32_t, header_count> m_first { };
 	};
 
 	namespace http_version {
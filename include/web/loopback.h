@@ -0,0 +1,53 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#pragma once
+
+#include <web/stream.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace web {
+	// A stream over in-process byte queues. The client side pushes raw
+	// request bytes and takes the raw response bytes; the server side
+	// is a regular stream, e.g. for server::on_connection. Reading an
+	// empty queue blocks, until more bytes are pushed or the input is
+	// closed, so both sides may run on separate threads.
+	class loopback : public stream::impl {
+		std::mutex m_mtx;
+		std::condition_variable m_cv;
+		std::string m_input;
+		size_t m_input_pos = 0;
+		bool m_input_closed = false;
+		std::string m_output;
+		bool m_shut = false;
+		endpoint_t m_local { "loopback", 80 };
+		endpoint_t m_remote { "127.0.0.1", 1024 };
+	public:
+		loopback() = default;
+		loopback(const loopback&) = delete;
+		loopback& operator=(const loopback&) = delete;
+
+		// client side
+		void push(std::string_view bytes);
+		void close_input();
+		std::string take_output();
+		// waits for at least size bytes of output, or for the shutdown
+		std::string take_output(size_t size);
+		bool was_shut();
+		void reset();
+
+		// server side
+		void shutdown(stream*) override;
+		bool overflow(stream* src, const void* data, size_t size, unsigned conn) override;
+		size_t read_some(stream* src, void* data, size_t size, unsigned conn) override;
+		bool writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn) override;
+		bool is_open(stream*) override;
+		endpoint_t remote_endpoint(stream*) override { return m_remote; }
+		endpoint_t local_endpoint(stream*) override { return m_local; }
+	};
+}
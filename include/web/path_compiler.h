@@ -7,8 +7,11 @@
 
 // https://github.com/pillarjs/path-to-regexp/blob/master/index.js
 
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <regex>
+#include <vector>
 
 namespace web {
 	enum {
@@ -63,6 +66,9 @@ namespace web {
 		}
 	};
 
+	// the strings and the keys of the mask, in order
+	std::vector<key_type> parse_matcher(const std::string& mask);
+
 	struct description {
 		std::string route;
 		std::vector<key_type> keys;
@@ -71,10 +77,12 @@ namespace web {
 		static description make(const std::string& mask, int options = COMPILE_DEFAULT);
 	};
 
+	// The names point into the compiled route, the values into the path
+	// given to matches().
 	struct param {
-		std::string sname;
+		std::string_view sname;
 		size_t nname;
-		std::string value;
+		std::string_view value;
 	};
 
 	struct matcher_type {
@@ -84,6 +92,6 @@ namespace web {
 		static matcher_type make(description const& tokens, int options = COMPILE_DEFAULT);
 		static matcher_type make(const std::string& mask, int options = COMPILE_DEFAULT);
 
-		bool matches(const std::string& route, std::vector<param>& params) const;
+		bool matches(std::string_view route, std::pmr::vector<param>& params) const;
 	};
 }
\ No newline at end of file
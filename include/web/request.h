@@ -9,7 +9,10 @@
 #include <web/headers.h>
 #include <web/uri.h>
 #include <web/path_compiler.h>
+#include <web/request_parser.h>
 
+#include <memory>
+#include <memory_resource>
 #include <unordered_map>
 
 namespace web {
@@ -27,43 +30,144 @@ namespace web {
 
 	method make_method(std::string& textual);
 
+	// Memory for everything a single request allocates, shared by the
+	// requests of a connection; release() drops it all at once, down to
+	// the first block, which is kept.
+	class request_arena {
+		static constexpr size_t block_size = 16 * 1024;
+		std::unique_ptr<char[]> m_block { new char[block_size] };
+		std::pmr::monotonic_buffer_resource m_resource { m_block.get(), block_size };
+	public:
+		std::pmr::memory_resource* get() { return &m_resource; }
+		void release() { m_resource.release(); }
+	};
+
+	class stream;
+
+	// The content of a request, read from the stream as it arrives: the
+	// Content-Length bytes, or the decoded Transfer-Encoding: chunked.
+	class content_reader {
+	public:
+		enum class framing {
+			none,
+			length,
+			chunked,
+			bad_length, // also with both fields present, i.e. smuggling
+			bad_coding  // anything but chunked
+		};
+
+		explicit content_reader(stream& io) : m_io { io } { }
+		static framing framing_of(const std::string_view* length, const std::string_view* coding, uint64_t& size);
+		static bool expects_continue(const request_headers& fields, http_version_t version);
+		framing open(const request_headers& fields, http_version_t version);
+		// Content past max fails the reads, which then take nothing more
+		// from the stream. A Content-Length above it fails the first one,
+		// or fits_limit(), which reads nothing.
+		void limit(uint64_t max) { m_max = max; }
+		bool fits_limit() { return m_chunked || fits(m_left); }
+		bool over_limit() const { return !m_chunked && m_read + m_left > m_max; }
+
+		// at most size bytes, as soon as any arrive; 0 at the end
+		size_t read(void* data, size_t size);
+		// the rest of the content, appended to dst
+		bool read_all(std::pmr::vector<char>& dst);
+		// the rest of the content, thrown away
+		bool skip();
+		bool done() const { return m_done; }
+		bool failed() const { return m_failed; }
+		bool too_large() const { return m_too_large; }
+
+		// The client waits for 100 Continue, before it sends the content.
+		// Content, which was never asked for, is not skipped either.
+		bool expects_continue() const { return m_expect; }
+		bool send_continue();
+		// Expect: 100-continue was answered, before the request was read,
+		// i.e. the route already took the request
+		bool admitted() const { return m_admitted; }
+		void continued()
+		{
+			m_admitted = true;
+			m_expect = false;
+		}
+	private:
+		// the next bytes of the content, inside the stream's buffer
+		std::string_view next(size_t limit);
+		bool invite();
+		bool fill();
+		bool fits(uint64_t more);
+
+		stream& m_io;
+		chunked_decoder m_chunks;
+		uint64_t m_left = 0;
+		uint64_t m_read = 0;
+		uint64_t m_max = UINT64_MAX;
+		bool m_chunked = false;
+		bool m_done = true;
+		bool m_failed = false;
+		bool m_too_large = false;
+		bool m_expect = false;
+		bool m_admitted = false;
+	};
+
 	class server;
-	class request_parser;
 	class request {
 		friend class request_parser;
 		friend class server;
 	protected:
+		// the copy of the head, the fields, the params, the content...
+		std::unique_ptr<request_arena> m_own_arena;
+		std::pmr::memory_resource* m_arena;
 		std::string m_remote;
 		std::string m_smethod;
-		web::method m_method;
+		web::method m_method = method::other;
 		web::uri m_uri;
-		http_version_t m_version;
-		std::vector<param> m_params;
-		web::headers m_headers;
-		std::vector<char> m_payload;
+		http_version_t m_version = http_version::http_none;
+		std::pmr::vector<param> m_params { m_arena };
+		web::request_headers m_headers { m_arena };
+		mutable std::pmr::vector<char> m_payload { m_arena };
+		content_reader* m_content = nullptr;
 		web::server* m_server;
 	public:
-		request(web::server* srv) : m_server{ srv } {}
+		// without an arena, the request gets one of its own
+		request(web::server* srv, std::pmr::memory_resource* arena = nullptr)
+			: m_own_arena { arena ? nullptr : new request_arena }
+			, m_arena { arena ? arena : m_own_arena->get() }
+			, m_server { srv }
+		{
+		}
+		// memory, which lives until the response is sent; for handlers,
+		// e.g. for std::pmr containers
+		std::pmr::memory_resource* arena() const { return m_arena; }
 		std::string const& remote() const { return m_remote; }
 		void remote(std::string const& remote) { m_remote = remote; }
 		web::server const* server() const { return m_server; }
 		const std::string& smethod() const { return m_smethod; }
 		web::method method() const { return m_method; }
 		const web::uri& uri() const { return m_uri; }
+		// the fields of the query, decoded only when asked to
+		query_view query() const { return query_view { m_uri.query() }; }
 		http_version_t version() const { return m_version; }
-		const std::vector<param>& params() const { return m_params; }
-		const std::string* find_param(const std::string& key) const;
-		const std::string* find_param(size_t key) const;
-		const web::headers& headers() const { return m_headers; }
+		const std::pmr::vector<param>& params() const { return m_params; }
+		const std::string_view* find_param(std::string_view key) const;
+		const std::string_view* find_param(size_t key) const;
+		const web::request_headers& headers() const { return m_headers; }
 
-		const std::vector<char>& payload() const { return m_payload; }
+		// The next part of the content, as soon as it arrives; 0 at its
+		// end. The content is not buffered, what the handler leaves
+		// unread is skipped after it returns.
+		size_t read(void* data, size_t size) const { return m_content ? m_content->read(data, size) : 0; }
+		// cut short, not well-formed, or larger than the route allows
+		bool content_failed() const { return m_content && m_content->failed(); }
+		bool content_too_large() const { return m_content && m_content->too_large(); }
+		// the content, which was not read() yet, loaded at the first call
+		const std::pmr::vector<char>& payload() const;
 
-		const std::string* find_front(const header_key& key) const
+		const std::string_view* find_front(const header_key& key) const
 		{
 			return m_headers.find_front(key);
 		}
-		const std::string* host() const { return find_front(header::Host); }
-		const std::string* content_type() const { return find_front(header::Content_Type); }
+		const std::string_view* host() const { return find_front(header::Host); }
+		const std::string_view* content_type() const { return find_front(header::Content_Type); }
 
 		std::unordered_map<std::string, std::string> post_form() const;
 	};
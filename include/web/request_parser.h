@@ -5,11 +5,29 @@
 
 #pragma once
 #include <web/headers.h>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
 
 namespace web {
 	enum class parsing {
 		separator,
-		error
+		error,
+		incomplete, // parse() needs more bytes
+		line_too_long, // 414 URI Too Long
+		head_too_large, // 431 Request Header Fields Too Large
+		content_too_large // 413 Payload Too Large, only from the async connection
+	};
+
+	// Limits on the size of a single request; zero turns a limit off.
+	struct request_limits {
+		size_t line = 8 * 1024;  // the request line, without the CRLF
+		size_t head = 64 * 1024; // the request line and all of the fields
+		size_t fields = 100;
+		// a cap over the limits of all the routes, see content_policy
+		uint64_t content = 0;
 	};
 
 	struct data_src {
@@ -19,11 +37,6 @@ namespace web {
 
 	class field_parser {
 	public:
-		static parsing read_line(data_src& src, std::vector<char>& dst);
-
-		parsing decode(data_src&);
-		bool rearrange(headers& dst);
-	private:
 		class span {
 		public:
 			constexpr span() = default;
@@ -38,49 +51,184 @@ namespace web {
 		private:
 			size_t m_offset = 0;
 			size_t m_length = 0;
-			size_t m_hash = 0;
 		};
 
-		std::vector<char> m_contents;
-		std::vector<std::tuple<span, span>> m_field_list;
-		size_t m_last_line_end = 0;
+		field_parser() = default;
+		explicit field_parser(std::pmr::memory_resource* arena) : m_field_list { arena } { }
 
-		std::string get(span s)
+		// a line longer than max, with the CRLF, is head_too_large
+		static parsing read_line(data_src& src, std::pmr::vector<char>& dst, size_t max = SIZE_MAX);
+
+		// Parses the complete lines from offset on and moves offset past
+		// them. Returns separator after the empty line ending the fields,
+		// or head_too_large for more than max_fields of them.
+		parsing parse(const char* data, size_t size, size_t& offset, size_t max_fields = 0);
+		// copies the head onto the arena, the fields in dst point there
+		bool rearrange(request_headers& dst, std::pmr::memory_resource& arena);
+		std::optional<std::string> find_front(const header_key& key) const;
+
+		// the spans are offsets into the bytes given to the last parse()
+		void rebase(const char* data) { m_data = data; }
+		void reserve(size_t count) { m_field_list.reserve(count); }
+		std::string get(span s) const
+		{
+			return { m_data + s.offset(), s.length() };
+		}
+		std::string_view view(span s) const
 		{
-			return { m_contents.data() + s.offset(), s.length() };
+			return { m_data + s.offset(), s.length() };
 		}
+	private:
+		const char* m_data = nullptr;
+		std::pmr::vector<std::tuple<span, span>> m_field_list;
 	};
 
 	template <typename Final>
 	class http_parser_base {
 	public:
+		http_parser_base() = default;
+		explicit http_parser_base(std::pmr::memory_resource* arena, const request_limits& limits = { })
+			: m_fields { arena }
+			, m_limits { limits }
+			, m_contents { arena }
+		{
+		}
+
+		// Parses the head in place. The data always starts with the first
+		// line and may grow between the calls, which return incomplete,
+		// until the empty line. Lines already parsed are not looked at
+		// again; the parser keeps only their offsets, so the bytes must
+		// stay, until the request is extracted. If they move, rebase().
+		// The limits are checked as the bytes come, before the head is
+		// complete.
+		parsing parse(const char* data, size_t size);
+		// Pulls the head from src line by line into a buffer of its own.
 		parsing decode(data_src&);
+		size_t head_length() const { return m_offset; }
+		void rebase(const char* data) { m_fields.rebase(data); }
+		const field_parser& fields() const { return m_fields; }
 	protected:
 		http_version_t m_proto;
 		field_parser m_fields;
+		request_limits m_limits;
+		size_t m_offset = 0;
+	private:
+		std::pmr::vector<char> m_contents;
 	};
 
 	template <typename Final>
-	inline parsing http_parser_base<Final>::decode(data_src& src)
+	inline parsing http_parser_base<Final>::parse(const char* data, size_t size)
 	{
-		auto& thiz = static_cast<Final&>(*this);
-		auto ret = thiz.first_line(src);
+		m_fields.rebase(data);
+
+		if (!m_offset) {
+			auto ret = static_cast<Final&>(*this).first_line(data, size, m_offset);
+			auto line = ret == parsing::separator ? m_offset - 2 : size;
+			if (m_limits.line && line > m_limits.line && ret != parsing::error)
+				return parsing::line_too_long;
+			if (ret != parsing::separator)
+				return ret;
+			m_fields.reserve(16); // a typical browser sends a dozen or so
+		}
+
+		auto ret = m_fields.parse(data, size, m_offset, m_limits.fields);
+		// the bytes after an incomplete head are all a part of it
+		auto head = ret == parsing::separator ? m_offset : size;
+		if (m_limits.head && head > m_limits.head && ret != parsing::error)
+			return parsing::head_too_large;
+		return ret;
+	}
 
-		if (ret != parsing::separator)
-			return ret;
+	template <typename Final>
+	inline parsing http_parser_base<Final>::decode(data_src& src)
+	{
+		while (true) {
+			auto ret = field_parser::read_line(src, m_contents, m_limits.head ? m_limits.head : SIZE_MAX);
+			if (ret != parsing::separator)
+				return ret;
 
-		return m_fields.decode(src);
+			ret = parse(m_contents.data(), m_contents.size());
+			if (ret != parsing::incomplete)
+				return ret;
+		}
 	}
 
+	// Transfer-Encoding: chunked, undone in place. Every call takes in as
+	// much of the bytes as it can, but stops after the first run of chunk
+	// data, which the body then points to; the size of the chunk and the
+	// extensions and trailers around the data are skipped.
+	class chunked_decoder {
+	public:
+		// the chunk extensions of one size line, and all the trailer
+		// lines together; longer ones fail the content
+		static constexpr size_t max_extension = 4 * 1024;
+		static constexpr size_t max_trailer = 16 * 1024;
+
+		// how many bytes were taken; at most limit of them go to the body
+		size_t decode(const char* data, size_t size, std::string_view& body, size_t limit = SIZE_MAX);
+		bool done() const { return m_state == state::done; }
+		bool failed() const { return m_state == state::error; }
+	private:
+		enum class state {
+			size,
+			extension,
+			size_lf,
+			data,
+			data_cr,
+			data_lf,
+			trailer_start,
+			trailer,
+			trailer_lf,
+			last_lf,
+			done,
+			error
+		};
+		state m_state = state::size;
+		uint64_t m_left = 0;
+		size_t m_digits = 0;
+		size_t m_line = 0; // of the extensions or the trailer so far
+	};
+
 	class request;
 
+	// "http://host[:port]" of the requests on one connection, normalised
+	// once and reused, as long as the next requests name the same host;
+	// the connection keeps it for the parsers of its requests.
+	class base_authority {
+	public:
+		// empty, if the host is not valid
+		std::string_view get(bool secure, std::string_view host, unsigned short port);
+	private:
+		std::string m_host;
+		std::string m_base;
+		unsigned short m_port = 0;
+		bool m_secure = false;
+		bool m_known = false;
+	};
+
 	class request_parser : public http_parser_base<request_parser> {
 		friend class http_parser_base<request_parser>;
-		parsing first_line(data_src&);
+		parsing first_line(const char* data, size_t size, size_t& offset);
 	public:
+		request_parser() = default;
+		// the request gets extracted onto the same arena
+		explicit request_parser(std::pmr::memory_resource* arena, const request_limits& limits = { }, base_authority* base = nullptr)
+			: http_parser_base<request_parser> { arena, limits }
+			, m_arena { arena }
+			, m_base { base }
+		{
+		}
+		std::pmr::memory_resource* arena() const { return m_arena; }
+		// Expect: 100-continue was answered, before the content arrived
+		bool continued() const { return m_continued; }
+		void continued(bool value) { m_continued = value; }
+
 		bool extract(bool secure, request& req, short unsigned port, const std::string& host_1_0 = { });
 	private:
-		std::string m_method;
-		std::string m_resource;
+		std::pmr::memory_resource* m_arena = nullptr;
+		base_authority* m_base = nullptr;
+		bool m_continued = false;
+		field_parser::span m_method;
+		field_parser::span m_resource;
 	};
 }
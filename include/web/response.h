@@ -8,6 +8,7 @@
 #include <web/headers.h>
 #include <web/stream.h>
 #include <exception>
+#include <stdexcept>
 #include <cstring>
 
 namespace web {
@@ -47,6 +48,7 @@ namespace web {
 	X(416, "Range Not Satisfiable", range_not_satisfiable) \
 	X(417, "Expectation Failed", expectation_failed) \
 	X(418, "I'm a teapot", im_a_teapot) \
+	X(431, "Request Header Fields Too Large", request_header_fields_too_large) \
 	X(500, "Internal Server Error", internal_server_error) \
 	X(501, "Not Implemented", not_implemented) \
 	X(502, "Bad Gateway", bad_gateway) \
@@ -79,25 +81,26 @@ namespace web {
 			throw std::runtime_error(name + ": cannot call after sending the headers");
 		}
 
+		std::string serialize_headers();
 		void send_headers();
 
 	public:
-		explicit response(web::stream* os, request* req_ref) : m_os(os), m_req_ref(req_ref) {
-		}
+		// the headers live on the request's arena
+		explicit response(web::stream* os, request* req_ref);
 
 		bool has(const header_key& key) const {
 			return m_headers.has(key);
 		}
-		void add(const header_key& key, std::string value)
+		void add(const header_key& key, std::string_view value)
 		{
 			throw_if_sent("add(header)");
-			m_headers.add(key, std::move(value));
+			m_headers.add(key, value);
 		}
-		void set(const header_key& key, std::string value)
+		void set(const header_key& key, std::string_view value)
 		{
 			throw_if_sent("set(header)");
 			m_headers.erase(key);
-			m_headers.add(key, std::move(value));
+			m_headers.add(key, value);
 		}
 		void set(const header_key& key, time_t value);
 		void erase(const header_key& key)
@@ -113,11 +116,11 @@ namespace web {
 		http_version_t version() const { return m_version; }
 		void cache_contents(bool value) { throw_if_sent("cache_contents"); m_cache_content = value; }
 
-		const std::string* find_front(const header_key& key) const
+		const std::pmr::string* find_front(const header_key& key) const
 		{
 			return m_headers.find_front(key);
 		}
-		const std::string* location() const { return find_front(header::Location); }
+		const std::pmr::string* location() const { return find_front(header::Location); }
 
 		void send_file(const std::string& path);
 		void write(const void* data, size_t length);
@@ -8,26 +8,56 @@
 #include <web/path_compiler.h>
 #include <web/request.h>
 #include <web/response.h>
+#include <cstdint>
 #include <memory>
 #include <regex>
 
 namespace web {
 	using endpoint_type = delegate<void(const request&, response&)>;
+
+	// How a route takes the content of its requests. Buffered routes
+	// find all of it in request::payload(), before the handler is called;
+	// streamed ones request::read() it, as it arrives. Larger content is
+	// answered with 413 Payload Too Large, or, once the streamed handler
+	// runs, fails the reads.
+	struct content_policy {
+		static constexpr uint64_t buffered_max = 1024 * 1024;
+		enum mode_t { buffered, streamed } mode = buffered;
+		// 0 for the default: buffered_max, or no limit when streamed
+		uint64_t max = 0;
+		// Looks at the head, before any of the content is read, e.g. for
+		// the credentials. A false answers the request with the response
+		// prepared here, and the handler is not called. A client, which
+		// waits for 100 Continue, then never sends the content.
+		delegate<bool(const request&, response&)> accept;
+
+		uint64_t limit() const
+		{
+			if (max)
+				return max;
+			return mode == buffered ? buffered_max : UINT64_MAX;
+		}
+	};
+
 	class route {
 		std::string m_mask;
 		matcher_type m_matcher;
 		endpoint_type m_endpoint;
+		content_policy m_content;
+		int m_options;
 
 		friend class router;
 		void mask(const std::string& value) { m_mask = value; }
 	public:
-		route(const std::string& mask, const endpoint_type& et, int options)
-			: m_mask(mask), m_matcher(web::matcher_type::make(mask, options)), m_endpoint(et)
+		route(const std::string& mask, const endpoint_type& et, int options, const content_policy& content = { })
+			: m_mask(mask), m_matcher(web::matcher_type::make(mask, options)), m_endpoint(et), m_content(content), m_options(options)
 		{
 		}
 
 		const std::string& mask() const { return m_mask; }
 		const web::matcher_type& matcher() const { return m_matcher; }
+		const content_policy& content() const { return m_content; }
+		int options() const { return m_options; }
 
 		void call(request& req, response& resp)
 		{
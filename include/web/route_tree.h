@@ -0,0 +1,48 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#pragma once
+
+#include <web/path_compiler.h>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace web {
+	class route;
+
+	// The routes of a single method. The literal parts of the masks make
+	// a compressed radix tree, which also has a child for a parameter
+	// taking a whole segment and one for the asterisk taking the rest of
+	// the path. Masks with anything else, e.g. custom patterns, optional
+	// or repeated parameters, or case-insensitive masks, hang at the end
+	// of their literal prefix and are matched with their regexes, once
+	// a path gets there. Of all the routes matching a path, the one added
+	// first wins, just like with trying them one by one.
+	class route_tree {
+	public:
+		route_tree();
+		route_tree(route_tree&&);
+		route_tree& operator=(route_tree&&);
+		~route_tree();
+
+		void add(const std::shared_ptr<route>& route);
+		std::shared_ptr<route> find(std::string_view path, std::pmr::vector<param>& params) const;
+
+		// the masks, which only their regexes can match
+		size_t regex_count() const { return m_regex_count; }
+	private:
+		struct node;
+		struct search;
+
+		void add_regex(const std::shared_ptr<route>& route, size_t index, const std::vector<key_type>& tokens);
+
+		std::unique_ptr<node> m_root;
+		size_t m_count = 0;
+		size_t m_regex_count = 0;
+	};
+}
@@ -7,6 +7,7 @@
 
 #include <web/route.h>
 #include <web/middleware.h>
+#include <web/route_tree.h>
 #include <unordered_map>
 
 namespace web {
@@ -20,17 +21,15 @@ namespace web {
 			route_list m_routes;
 			sroute_list m_sroutes;
 			filter_list m_middleware;
+			// the same routes, for find()
+			std::unordered_map<method, route_tree> m_trees;
+			std::unordered_map<std::string, route_tree> m_strees;
 		public:
 			compiled() = default;
-			explicit compiled(route_list&& routes, sroute_list&& sroutes, filter_list&& middleware)
-				: m_routes(std::move(routes))
-				, m_sroutes(std::move(sroutes))
-				, m_middleware(std::move(middleware))
-			{
-			}
+			explicit compiled(route_list&& routes, sroute_list&& sroutes, filter_list&& middleware);
 
-			std::shared_ptr<route> find(method m, const std::string& route, std::vector<param>& params);
-			std::shared_ptr<route> find(const std::string& other_method, const std::string& route, std::vector<param>& params);
+			std::shared_ptr<route> find(method m, std::string_view route, std::pmr::vector<param>& params);
+			std::shared_ptr<route> find(const std::string& other_method, std::string_view route, std::pmr::vector<param>& params);
 			const route_list& routes() const { return m_routes; }
 			const sroute_list& sroutes() const { return m_sroutes; }
 			const auto& filters() const { return m_middleware; }
@@ -45,6 +44,7 @@ namespace web {
 			std::string mask;
 			endpoint_type endpoint;
 			int options;
+			content_policy content;
 		};
 
 		using handlers = std::unordered_map<method, std::vector<handler>>;
@@ -64,6 +64,9 @@ namespace web {
 
 		void add(const std::string& path, const endpoint_type& et, method m = method::get, int options = COMPILE_DEFAULT);
 		void add(const std::string& path, const endpoint_type& et, const std::string& other_method, int options = COMPILE_DEFAULT);
+		// e.g. add("/upload", et, method::put, { content_policy::streamed, 1ull << 32 })
+		void add(const std::string& path, const endpoint_type& et, method m, const content_policy& content, int options = COMPILE_DEFAULT);
+		void add(const std::string& path, const endpoint_type& et, const std::string& other_method, const content_policy& content, int options = COMPILE_DEFAULT);
 
 		void get(const std::string& path, const endpoint_type& et, int options = COMPILE_DEFAULT) {
 			add(path, et, method::get, options);
@@ -8,29 +8,97 @@
 #ifdef HTTP_USE_ASIO
 #include <web/bits/asio.h>
 #endif
+#ifdef HTTP_USE_URING
+#include <web/bits/uring.h>
+#endif
 
+#include <web/request_parser.h>
 #include <web/router.h>
+#include <web/delegate.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <optional>
 
 namespace web {
 #ifdef HTTP_USE_ASIO
+	using asio::backend;
 	using asio::endpoint;
+	using asio::execution;
+	using asio::shard_stats;
+	using asio::timeouts;
 #endif
+	// requests refused for the request_limits, since the server started
+	struct limit_stats {
+		size_t line{};    // 414, the request line
+		size_t head{};    // 431, the size or the number of the fields
+		size_t content{}; // 413
+	};
+
+	// Called by on_connection() after each request, on its thread, with
+	// the time taken to read and parse the head, and then by on_request().
+	using stage_timer = delegate<void(std::chrono::nanoseconds parse, std::chrono::nanoseconds handle)>;
+
 	class server {
 		router::compiled m_routes;
+		uint64_t m_max_content = content_policy::buffered_max;
+		request_limits m_limits;
+		stage_timer m_stage_timer;
+		struct {
+			std::atomic<size_t> line{};
+			std::atomic<size_t> head{};
+			std::atomic<size_t> content{};
+		} m_rejected;
 #ifdef HTTP_USE_ASIO
 		asio::service m_svc;
 #endif
-		void load_content(stream& io, request& req);
+#ifdef HTTP_USE_URING
+		std::unique_ptr<uring::service> m_uring;
+#endif
 		void handle_connection(request& req, response& resp);
+		std::shared_ptr<route> find_route(request& req, std::pmr::vector<param>& params);
+		bool admit(route& handler, request& req, response& resp);
+		uint64_t capped(uint64_t limit) const
+		{
+			return m_limits.content ? std::min(limit, m_limits.content) : limit;
+		}
 	public:
 		server();
 		void set_server(const std::string&);
 		const std::string& get_server() const { return m_svc.server(); }
+#ifdef HTTP_USE_ASIO
+		void set_execution(execution mode);
+		void set_threads(size_t count);
+		void set_stack_size(size_t size);
+		void set_max_threads(size_t count);
+		void set_sharded(bool sharded);
+		void set_workers(size_t count, size_t queue_depth = 0);
+		void set_timeouts(const timeouts& limits);
+		// most responses to pipelined requests gathered into one write
+		void set_pipeline_depth(size_t depth);
+		std::vector<asio::shard_stats> stats() const;
+#endif
 		void set_routes(router& router);
+		void set_limits(const request_limits& limits) { m_limits = limits; }
+		const request_limits& limits() const { return m_limits; }
+		limit_stats rejected() const;
+		// for benchmarks; set it before the server runs
+		void set_stage_timer(const stage_timer& timer) { m_stage_timer = timer; }
+		// the most content the async execution holds for a single request
+		static constexpr uint64_t async_content_max = 64 * 1024 * 1024;
+		// the largest limit of the routes, up to async_content_max; the
+		// async execution answers content above it with 413, unread
+		uint64_t max_content() const { return capped(std::min(m_max_content, async_content_max)); }
 		void print() const;
-		std::optional<endpoint> listen(unsigned short port);
+		// backend::io_uring falls back to asio, if the kernel has no io_uring
+		std::optional<endpoint> listen(unsigned short port, backend which = backend::asio);
 		void run();
 		void on_connection(stream& io, bool secure);
+		bool on_request(stream& io, request_parser& parser, bool secure);
+		bool on_overload(stream& io, request_parser& parser, bool secure);
+		bool on_expect(stream& io, request_parser& parser, bool secure);
+		// answers a head over the limits, the reason is what parse() said,
+		// or content_too_large from the async connection
+		void on_rejected(stream& io, request_parser& parser, parsing reason);
 	};
 }
@@ -8,7 +8,9 @@
 #include <array>
 #include <vector>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <string>
 
 namespace web {
 	template <typename Final, size_t BufferLength = 4192>
@@ -39,6 +41,19 @@ namespace web {
 		}
 	public:
 		size_t write(const void* data, size_t size)
+		{
+			// would only be chopped into buffer-sized chunks anyway
+			if (size >= BufferLength)
+				return static_cast<Final*>(this)->write_through(data, size);
+			return write_staged(data, size);
+		}
+
+		size_t write_through(const void* data, size_t size)
+		{
+			return write_staged(data, size);
+		}
+
+		size_t write_staged(const void* data, size_t size)
 		{
 			size_t written = 0;
 			auto ptr = static_cast<const char*>(data);
@@ -60,42 +75,87 @@ namespace web {
 		bool overflow() { return false; }
 	};
 
-	template <typename Final>
+	template <typename Final, size_t ChunkLength = 8192>
 	class istream {
 		size_t m_read_ptr = 0;
+		size_t m_read_end = 0;
 		std::vector<char> m_input;
 
-		bool load(void* data, size_t size)
+		bool load()
 		{
-			if (m_read_ptr == m_input.size()) {
-				if (!static_cast<Final*>(this)->underflow())
-					return false;
+			auto space = read_space(ChunkLength);
+			auto received = static_cast<Final*>(this)->read_some(std::get<0>(space), std::get<1>(space));
+			m_read_end += received;
+			return received != 0;
+		}
+	protected:
+		// Room for at least size more bytes after the unread ones. The
+		// unread bytes are moved to the front before the buffer grows.
+		std::pair<char*, size_t> read_space(size_t size)
+		{
+			if (m_read_ptr == m_read_end)
+				m_read_ptr = m_read_end = 0;
+
+			if (m_input.size() - m_read_end < size) {
+				if (m_read_ptr) {
+					std::memmove(m_input.data(), m_input.data() + m_read_ptr, m_read_end - m_read_ptr);
+					m_read_end -= m_read_ptr;
+					m_read_ptr = 0;
+				}
+				if (m_input.size() - m_read_end < size)
+					m_input.resize(m_read_end + size);
 			}
-			assert((m_read_ptr + size) <= m_input.size());
 
-			memcpy(data, m_input.data() + m_read_ptr, size);
-			m_read_ptr += size;
+			return { m_input.data() + m_read_end, m_input.size() - m_read_end };
+		}
+	public:
+		// The bytes received, but not read yet. They stay in place until
+		// the next read() or fill().
+		std::pair<const char*, size_t> peek() const
+		{
+			return { m_input.data() + m_read_ptr, m_read_end - m_read_ptr };
+		}
 
-			return true;
+		// Receives more bytes after the unread ones, which may move.
+		bool fill()
+		{
+			return load();
 		}
-	protected:
-		void refill(const char* ptr, size_t len)
+
+		void consume(size_t size)
 		{
-			m_read_ptr = 0;
-			m_input.assign(ptr, ptr + len);
+			assert(size <= m_read_end - m_read_ptr);
+			m_read_ptr += size;
 		}
-	public:
+
 		size_t read(void* data, size_t size)
 		{
 			size_t read_amount = 0;
 			auto ptr = static_cast<char*>(data);
 			while (size) {
+				auto rest = m_read_end - m_read_ptr;
+				if (!rest) {
+					// nothing buffered, large reads land in the caller's memory
+					if (size >= ChunkLength) {
+						auto received = static_cast<Final*>(this)->read_some(ptr, size);
+						if (!received)
+							break;
+						size -= received;
+						read_amount += received;
+						ptr += received;
+						continue;
+					}
+
+					if (!load())
+						break;
+					rest = m_read_end - m_read_ptr;
+				}
+
 				auto chunk = size;
-				auto rest = m_input.size() - m_read_ptr;
 				if (chunk > rest)
 					chunk = rest;
-				if (!load(ptr, chunk))
-					break;
+				std::memcpy(ptr, m_input.data() + m_read_ptr, chunk);
+				m_read_ptr += chunk;
 				size -= chunk;
 				read_amount += chunk;
 				ptr += chunk;
@@ -103,12 +163,25 @@ namespace web {
 			return read_amount;
 		}
 
-		bool underflow()
+		size_t read_some(void*, size_t)
 		{
-			return false;
+			return 0;
 		}
 	};
 
+	struct buffer_view {
+		const void* data;
+		size_t size;
+	};
+
+	// what a connection is busy with, picks the timeout of the next read
+	enum class io_stage {
+		idle, // waiting for the next request
+		head, // reading the request line and the fields
+		body, // reading the content
+		reply // running the handler and writing the response
+	};
+
 	struct endpoint_t {
 		std::string host;
 		unsigned short port;
@@ -122,7 +195,18 @@ namespace web {
 			virtual ~impl();
 			virtual void shutdown(stream* src) = 0;
 			virtual bool overflow(stream* src, const void* data, size_t size, unsigned conn) = 0;
-			virtual bool underflow(stream* src, unsigned conn) = 0;
+			// receives at most size bytes straight into data; 0 for closed
+			// or failed streams
+			virtual size_t read_some(stream* src, void* data, size_t size, unsigned conn) = 0;
+			// all of the buffers, in order, preferably as a single write;
+			// the default calls overflow() for each of them
+			virtual bool writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn);
+			// zero-copy transfer of a range of an open file; streams, which
+			// say they can't, are fed through overflow() instead
+			virtual bool can_send_file(stream* src);
+			virtual bool send_file(stream* src, int fd, uint64_t offset, uint64_t length, unsigned conn);
+			// the default ignores the stages
+			virtual void stage(stream* src, io_stage next);
 			virtual bool is_open(stream* src) = 0;
 			virtual endpoint_t local_endpoint(stream* src) = 0;
 			virtual endpoint_t remote_endpoint(stream* src) = 0;
@@ -130,25 +214,72 @@ namespace web {
 
 		stream(impl& ref) : m_impl { ref } { }
 		void flushed_write() { ostream<stream>::flushed(); }
-		void refill_read(const void* data, size_t length)
-		{
-			istream<stream>::refill(static_cast<const char*>(data), length);
-		}
 
 		void shutdown()
 		{
+			send_held();
 			m_impl.shutdown(this);
 		}
 		void conn_no(unsigned val) { conn_ = val; }
+		unsigned conn_no() const { return conn_; }
 		bool overflow()
 		{
 			auto data = write_data();
+			if (m_corked)
+				return writev(nullptr, 0); // takes the staged bytes
 			return m_impl.overflow(this, std::get<0>(data), std::get<1>(data), conn_);
 		}
 
-		bool underflow()
+		size_t read_some(void* data, size_t size)
+		{
+			// the client may wait for the held responses
+			if (!send_held())
+				return 0;
+			return m_impl.read_some(this, data, size, conn_);
+		}
+
+		// While corked, the writes are held back and go out together,
+		// before the next read, or once they grow past held_limit. This
+		// gathers the responses to pipelined requests, which are already
+		// received, into a single write.
+		static constexpr size_t held_limit = 64 * 1024;
+		void cork() { m_corked = true; }
+		bool uncork()
+		{
+			m_corked = false;
+			return send_held();
+		}
+		bool held() const { return !m_held.empty(); }
+		bool send_held();
+
+		// sends out whatever is staged, followed by the buffers
+		bool writev(const buffer_view* buffers, size_t count);
+		size_t write_through(const void* data, size_t size)
+		{
+			buffer_view buffer { data, size };
+			return writev(&buffer, 1) ? size : 0;
+		}
+
+		bool can_send_file()
+		{
+			return m_impl.can_send_file(this);
+		}
+
+		bool send_file(int fd, uint64_t offset, uint64_t length)
+		{
+			return flush() && send_held() && m_impl.send_file(this, fd, offset, length, conn_);
+		}
+
+		bool flush()
+		{
+			if (!std::get<1>(write_data()))
+				return true;
+			return overflow();
+		}
+
+		void stage(io_stage next)
 		{
-			return m_impl.underflow(this, conn_);
+			m_impl.stage(this, next);
 		}
 
 		bool is_open()
@@ -168,5 +299,7 @@ namespace web {
 	private:
 		impl& m_impl;
 		unsigned conn_{ 0 };
+		bool m_corked = false;
+		std::vector<char> m_held;
 	};
 }
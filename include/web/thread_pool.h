@@ -0,0 +1,55 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#else
+#include <thread>
+#endif
+
+namespace web {
+	// Long-lived threads for blocking jobs. A thread is started only when
+	// no other is idle, up to max_threads (0 for no limit); past that, the
+	// jobs wait in the queue for a thread to finish its current one.
+	class thread_pool {
+	public:
+		using job = std::function<void()>;
+
+		thread_pool(size_t max_threads, size_t stack_size);
+		~thread_pool();
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		void post(job&& task);
+		void stop();
+
+		size_t threads() const;
+	private:
+#if defined(__unix__) || defined(__APPLE__)
+		using native_thread = pthread_t;
+#else
+		using native_thread = std::thread;
+#endif
+		mutable std::mutex m_mtx;
+		std::condition_variable m_cv;
+		std::deque<job> m_jobs;
+		std::vector<native_thread> m_threads;
+		size_t m_idle = 0;
+		size_t m_max_threads;
+		size_t m_stack_size;
+		bool m_stopped = false;
+
+		bool spawn();
+		void work();
+	};
+}
@@ -36,6 +36,8 @@ utilities.
 
 #include <unordered_map>
 #include <vector>
+#include <iterator>
+#include <optional>
 #include <string>
 #include <string_view>
 
@@ -519,6 +521,23 @@ namespace web {
 		*/
 		static uri canonical(const uri& identifier, const uri& base, auth_flag flag = ui_safe);
 
+		/**
+		Checks, if an origin-form request target is already normal.
+
+		The target is a path starting with a slash, optionally followed
+		by a query. It is normal, if normal() would leave it as it is:
+		there are no empty, <code>"."</code> or <code>".."</code>
+		segments (except for an empty one at the end), the path has
+		only unreserved characters and the percent-encodings, which
+		use upper-case digits for the characters that need them. There
+		is no fragment.
+
+		\param target a path with an optional query
+		\returns true, if the target can be appended to a normal
+		         authority as it is
+		*/
+		static bool is_normal_origin(std::string_view target);
+
 		/**
 		Normalizes the input.
 
@@ -541,4 +560,89 @@ namespace web {
 		*/
 		static uri normal(uri identifier, auth_flag flag = ui_safe);
 	};
+
+	/**
+	Allocation-free view of a query component, or of a form sent as
+	<code>application/x-www-form-urlencoded</code>.
+
+	The fields are split on <code>"&"</code> and on the first
+	<code>"="</code> while iterating and are given as they were
+	received; the empty ones are skipped. decode() turns a raw name or
+	value into its text, copying it only if there is anything to
+	decode. The view does not own the query.
+	*/
+	class query_view {
+	public:
+		/** A field, as it is found in the query */
+		struct field {
+			std::string_view name; /**< Raw name of the field */
+			std::string_view value; /**< Raw value; empty, if there was no <code>"="</code> */
+		};
+
+		/** Forward iterator over the fields */
+		class iterator {
+		public:
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = field;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const field*;
+			using reference = const field&;
+
+			iterator() = default;
+			iterator(const char* cur, const char* end);
+
+			reference operator*() const { return m_field; }
+			pointer operator->() const { return &m_field; }
+			iterator& operator++() { next(); return *this; }
+			iterator operator++(int) { auto tmp = *this; next(); return tmp; }
+			bool operator==(const iterator& rhs) const { return m_cur == rhs.m_cur; }
+			bool operator!=(const iterator& rhs) const { return m_cur != rhs.m_cur; }
+		private:
+#ifndef USING_DOXYGEN
+			void next();
+
+			const char* m_cur = nullptr; // the field, or end
+			const char* m_next = nullptr; // after the field's "&"
+			const char* m_end = nullptr;
+			field m_field;
+#endif
+		};
+
+		query_view() = default;
+
+		/**
+		Constructs a view of the query.
+		\param query a query component, with or without the
+		             leading question mark, or a form
+		*/
+		explicit query_view(std::string_view query);
+
+		iterator begin() const { return { m_query.data(), m_query.data() + m_query.length() }; }
+		iterator end() const { auto stop = m_query.data() + m_query.length(); return { stop, stop }; }
+		bool empty() const { return begin() == end(); }
+
+		/**
+		Looks for the first field with the name.
+		\param name a decoded name of the field
+		\returns the raw value of the field, if present
+		*/
+		std::optional<std::string_view> find_front(std::string_view name) const;
+
+		/**
+		Decodes a raw name or value: percent-encodings are
+		replaced with their octets and pluses with spaces.
+
+		\param raw a name or value from a field
+		\param buffer a place for the decoded text, used
+		              only if the raw text has any
+		              <code>"%"</code> or <code>"+"</code>
+		\returns either raw, or a view of the buffer
+		*/
+		static std::string_view decode(std::string_view raw, std::string& buffer);
+
+	private:
+#ifndef USING_DOXYGEN
+		std::string_view m_query;
+#endif
+	};
 }
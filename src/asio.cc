@@ -6,14 +6,124 @@
 #include <web/server.h>
 #include <mutex>
 #include <condition_variable>
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#endif
 
 unsigned get_thid();
 
 namespace web { namespace asio {
 
-	void connection::asio_stream::write_data(RX& rx, unsigned tid, unsigned conn)
+	namespace {
+		std::vector<const_buffer> as_sequence(const buffer_view* buffers, size_t count)
+		{
+			std::vector<const_buffer> out;
+			out.reserve(count);
+			for (size_t i = 0; i < count; ++i)
+				out.emplace_back(buffers[i].data, buffers[i].size);
+			return out;
+		}
+
+		size_t total_size(const buffer_view* buffers, size_t count)
+		{
+			size_t size = 0;
+			for (size_t i = 0; i < count; ++i)
+				size += buffers[i].size;
+			return size;
+		}
+
+		constexpr bool has_sendfile()
+		{
+#ifdef __linux__
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		// Sends as much of the file range, as the socket takes without
+		// blocking; error::would_block asks to wait for the socket.
+		error_code send_file_some(ip::tcp::socket& socket, int fd, uint64_t& offset, uint64_t& length)
+		{
+#ifdef __linux__
+			// the kernel caps a single call a bit below 2 GiB anyway
+			static constexpr uint64_t max_chunk = 0x40000000;
+
+			error_code ec;
+			socket.native_non_blocking(true, ec);
+			if (ec)
+				return ec;
+
+			while (length) {
+				auto pos = static_cast<off_t>(offset);
+				auto sent = ::sendfile(socket.native_handle(), fd, &pos, static_cast<size_t>(std::min(length, max_chunk)));
+				if (sent < 0) {
+					if (errno == EINTR)
+						continue;
+					if (errno == EAGAIN || errno == EWOULDBLOCK)
+						return error::would_block;
+					return { errno, boost::system::system_category() };
+				}
+				if (!sent) // the file got shorter, than promised
+					return error::eof;
+				offset += static_cast<uint64_t>(sent);
+				length -= static_cast<uint64_t>(sent);
+			}
+			return { };
+#else
+			(void)socket; (void)fd; (void)offset; (void)length;
+			return error::operation_not_supported;
+#endif
+		}
+
+		// sendfile(2) driven by the readiness of the socket, calling the
+		// handler once, through the executor, with the final result
+		template <typename Executor, typename Handler>
+		struct send_file_op {
+			connection& owner;
+			ip::tcp::socket& socket;
+			Executor ex;
+			int fd;
+			uint64_t offset;
+			uint64_t length;
+			Handler handler;
+
+			void operator()(error_code ec = { })
+			{
+				if (!ec) {
+					auto before = offset;
+					ec = send_file_some(socket, fd, offset, length);
+					if (ec == error::would_block) {
+						if (offset != before)
+							owner.writing();
+						socket.async_wait(socket_base::wait_write, bind_executor(ex, std::move(*this)));
+						return;
+					}
+				}
+				handler(ec);
+			}
+		};
+
+		template <typename Executor, typename Handler>
+		void async_send_file(connection& owner, ip::tcp::socket& socket, const Executor& ex, int fd, uint64_t offset, uint64_t length, Handler&& handler)
+		{
+			// never completes inline, coroutines need to yield first
+			owner.writing();
+			post(ex, send_file_op<Executor, std::decay_t<Handler>> { owner, socket, ex, fd, offset, length, std::forward<Handler>(handler) });
+		}
+	}
+
+	void threaded_connection::asio_stream::write_data(RX& rx, unsigned tid, unsigned conn)
 	{
-		async_write(m_socket, buffer(rx.data, rx.transferred), [&, this, tid, conn](error_code ec, std::size_t bytes_transferred) {
+		async_write(m_socket, as_sequence(rx.buffers, rx.count), bind_executor(m_strand, [&, this, tid, conn](error_code ec, std::size_t bytes_transferred) {
+			std::lock_guard<std::mutex> lock { m_mtx };
 			if (ec) {
 				rx.status = failed;
 				LOG_DBG2() << "asio_stream::write_data(this:" << this << ", rx, #" << tid << "." << conn << ") -- failed: " << ec.message();
@@ -23,12 +133,13 @@ namespace web { namespace asio {
 				LOG_DBG2() << "asio_stream::write_data(this:" << this << ", rx, #" << tid << "." << conn << ") --> " << bytes_transferred;
 			}
 			m_cv.notify_one();
-		});
+		}));
 	}
 
-	void connection::asio_stream::read_data(TX& tx, unsigned tid, unsigned conn)
+	void threaded_connection::asio_stream::read_data(TX& tx, unsigned tid, unsigned conn)
 	{
-		m_socket.async_read_some(buffer(tx.data), [&, this, tid, conn](error_code ec, std::size_t bytes_transferred) {
+		m_socket.async_read_some(buffer(tx.data, tx.size), bind_executor(m_strand, [&, this, tid, conn](error_code ec, std::size_t bytes_transferred) {
+			std::lock_guard<std::mutex> lock { m_mtx };
 			if (ec) {
 				tx.status = failed;
 				LOG_DBG2() << "asio_stream::read_data(this:" << this << ", tx, #" << tid << "." << conn << ") -- failed: " << ec.message();
@@ -38,10 +149,10 @@ namespace web { namespace asio {
 				LOG_DBG2() << "asio_stream::read_data(this:" << this << ", tx, #" << tid << "." << conn << ") --> " << bytes_transferred;
 			}
 			m_cv.notify_one();
-		});
+		}));
 	}
 
-	void connection::asio_stream::shutdown(stream* src)
+	void threaded_connection::asio_stream::shutdown(stream* src)
 	{
 		if (socket_aborting) {
 			LOG_WRN() << "asio_stream::shutdown(this:" << this << ", src:" << src << ") -- while aborting";
@@ -49,229 +160,1214 @@ namespace web { namespace asio {
 		}
 
 		auto shared = m_parent->shared_from_this();
-		m_socket.get_io_service().post([parent = m_parent, shared, this, src] {
+		post(m_strand, [parent = m_parent, shared, this, src] {
 			LOG_DBG2() << "asio_stream::shutdown(this:" << this << ", src:" << src << ")::lambda";
 			parent->shutdown();
 			LOG_DBG2() << "asio_stream::shutdown(this:" << this << ", src:" << src << ") -- done";
 		});
 	}
 
-	bool connection::asio_stream::overflow(stream* src, const void* data, size_t size, unsigned conn)
+	bool threaded_connection::asio_stream::overflow(stream* src, const void* data, size_t size, unsigned conn)
+	{
+		buffer_view buffer { data, size };
+		return writev(src, &buffer, 1, conn);
+	}
+
+	bool threaded_connection::asio_stream::writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn)
 	{
 		std::unique_lock<std::mutex> lock { m_mtx };
 
-		LOG_DBG2() << "asio_stream::overflow(this:" << this << ", src:" << src << ", data:" << data << ", size:" << size << ")";
+		auto size = total_size(buffers, count);
+		LOG_DBG2() << "asio_stream::writev(this:" << this << ", src:" << src << ", count:" << count << ", size:" << size << ")";
 
 		RX rx;
-		rx.data = data;
-		rx.transferred = size;
+		rx.buffers = buffers;
+		rx.count = count;
+		m_parent->writing();
 
 		auto shared = m_parent->shared_from_this();
 		auto thid = get_thid();
-		m_socket.get_io_service().post([&, this, shared, thid, conn] {
+		post(m_strand, [&, this, shared, thid, conn] {
 			write_data(rx, thid, conn);
 		});
 
 		m_cv.wait(lock, [&] { return rx.status != running; });
 		if (rx.status == succeeded) {
-			LOG_DBG2() << "asio_stream::overflow(this:" << this << ", src:" << src << ", data:" << data << ", size:" << size << ") -- success";
+			LOG_DBG2() << "asio_stream::writev(this:" << this << ", src:" << src << ", count:" << count << ", size:" << size << ") -- success";
+			m_parent->written();
 			src->flushed_write();
 			return rx.transferred == size;
 		} else {
-			LOG_DBG2() << "asio_stream::overflow(this:" << this << ", src:" << src << ", data:" << data << ", size:" << size << ") -- failed, rx.status:" << static_cast<int>(rx.status);
+			LOG_DBG2() << "asio_stream::writev(this:" << this << ", src:" << src << ", count:" << count << ", size:" << size << ") -- failed, rx.status:" << static_cast<int>(rx.status);
 			return false;
 		}
 	}
 
-	bool connection::asio_stream::underflow(stream* src, unsigned conn)
+	bool threaded_connection::asio_stream::can_send_file(stream*)
+	{
+		return has_sendfile();
+	}
+
+	bool threaded_connection::asio_stream::send_file(stream* src, int fd, uint64_t offset, uint64_t length, unsigned conn)
 	{
 		std::unique_lock<std::mutex> lock { m_mtx };
 
-		LOG_DBG2() << "asio_stream::undeflow(this:" << this << ", src:" << src << ")";
+		LOG_DBG2() << "asio_stream::send_file(this:" << this << ", src:" << src << ", fd:" << fd << ", length:" << length << ")";
+
+		int status = running;
+		auto shared = m_parent->shared_from_this();
+		auto thid = get_thid();
+		post(m_strand, [&, this, shared, thid, conn] {
+			async_send_file(*m_parent, m_socket, m_strand, fd, offset, length, [&, this, thid, conn](error_code ec) {
+				std::lock_guard<std::mutex> lock { m_mtx };
+				if (ec) {
+					status = failed;
+					LOG_DBG2() << "asio_stream::send_file(this:" << this << ", #" << thid << "." << conn << ") -- failed: " << ec.message();
+				} else
+					status = succeeded;
+				m_cv.notify_one();
+			});
+		});
+
+		m_cv.wait(lock, [&] { return status != running; });
+		if (status != succeeded)
+			return false;
+		m_parent->written();
+		return true;
+	}
+
+	void threaded_connection::asio_stream::stage(stream*, io_stage next)
+	{
+		m_parent->stage(next);
+	}
+
+	size_t threaded_connection::asio_stream::read_some(stream* src, void* data, size_t size, unsigned conn)
+	{
+		std::unique_lock<std::mutex> lock { m_mtx };
+
+		LOG_DBG2() << "asio_stream::read_some(this:" << this << ", src:" << src << ", size:" << size << ")";
 
 		TX tx;
+		tx.data = data;
+		tx.size = size;
 		auto shared = m_parent->shared_from_this();
 		auto thid = get_thid();
-		m_socket.get_io_service().post([&, this, shared, conn] {
+		post(m_strand, [&, this, shared, conn] {
 			read_data(tx, thid, conn);
 		});
 
 		m_cv.wait(lock, [&] { return tx.status != running; });
 		if (tx.status == succeeded) {
-			LOG_DBG2() << "asio_stream::undeflow(this:" << this << ", src:" << src << ") -- success";
-			src->refill_read(tx.data.data(), tx.transferred);
-			return !!tx.transferred;
+			LOG_DBG2() << "asio_stream::read_some(this:" << this << ", src:" << src << ") -- success";
+			if (tx.transferred)
+				m_parent->received();
+			return tx.transferred;
 		} else {
-			LOG_DBG2() << "asio_stream::undeflow(this:" << this << ", src:" << src << ") -- failed, tx.status:" << static_cast<int>(tx.status);
-			return false;
+			LOG_DBG2() << "asio_stream::read_some(this:" << this << ", src:" << src << ") -- failed, tx.status:" << static_cast<int>(tx.status);
+			return 0;
 		}
 	}
 
-	bool connection::asio_stream::is_open(stream* src)
+	// only the strand touches the socket, once the handler thread runs
+	bool threaded_connection::asio_stream::is_open(stream*)
 	{
-		return m_socket.is_open();
+		return !socket_aborting;
 	}
 
-	endpoint_t connection::asio_stream::remote_endpoint(stream*)
+	endpoint_t threaded_connection::asio_stream::remote_endpoint(stream*)
 	{
-		auto ep = m_socket.remote_endpoint();
-		return { ep.address().to_string(), ep.port() };
+		return m_remote;
+	}
+
+	endpoint_t threaded_connection::asio_stream::local_endpoint(stream*)
+	{
+		return m_local;
 	}
 
-	endpoint_t connection::asio_stream::local_endpoint(stream*)
+	void threaded_connection::asio_stream::opened()
 	{
-		return { ip::host_name(), m_socket.local_endpoint().port() };
+		error_code ec;
+		auto remote = m_socket.remote_endpoint(ec);
+		if (!ec)
+			m_remote = { remote.address().to_string(), remote.port() };
+		m_local = { ip::host_name(), m_socket.local_endpoint(ec).port() };
 	}
 
-	void connection::asio_stream::close()
+	void threaded_connection::asio_stream::close()
 	{
 		LOG_DBG2() << "asio_stream::close(this:" << this << ") -------------------------------------------------------";
 		socket_aborting = true;
-		m_socket.close();
+		auto shared = m_parent->shared_from_this();
+		dispatch(m_strand, [this, shared] {
+			error_code ec;
+			m_socket.close(ec);
+		});
+	}
+
+	connection::connection(connection_manager& manager)
+		: m_connection_manager { manager }
+	{
+	}
+
+	connection::~connection() = default;
+
+	void connection::shutdown()
+	{
+		LOG_DBG2() << "connection::shutdown(this:" << this << ")";
+		m_connection_manager.stop(shared_from_this());
+	}
+
+	void connection::expire()
+	{
+		LOG_DBG2() << "connection::expire(this:" << this << ")";
+		m_connection_manager.expire(shared_from_this());
+	}
+
+	void connection::arm(std::chrono::milliseconds timeout)
+	{
+		if (timeout.count() > 0)
+			m_connection_manager.wheel().arm(*this, timeout);
+		else
+			disarm();
+	}
+
+	void connection::disarm()
+	{
+		m_connection_manager.wheel().disarm(*this);
+	}
+
+	void connection::stage(io_stage next)
+	{
+		m_stage = next;
+		auto& limits = m_connection_manager.timeouts();
+		switch (next) {
+		case io_stage::idle: arm(limits.idle); break;
+		case io_stage::head: arm(limits.head); break;
+		case io_stage::body: arm(limits.body); break;
+		case io_stage::reply: disarm(); break;
+		}
+	}
+
+	void connection::received()
+	{
+		// the head has a single deadline, the body is limited per read
+		if (m_stage == io_stage::idle)
+			stage(io_stage::head);
+		else if (m_stage == io_stage::body)
+			stage(io_stage::body);
+	}
+
+	void connection::writing()
+	{
+		arm(m_connection_manager.timeouts().write);
+	}
+
+	void connection::written()
+	{
+		if (m_stage != io_stage::head)
+			stage(m_stage);
+	}
+
+	timer_wheel::timer_wheel(io_service& io, io_service::strand& strand)
+		: m_strand { strand }
+		, m_timer { io }
+		, m_start { clock::now() }
+	{
+	}
+
+	uint64_t timer_wheel::now() const
+	{
+		return static_cast<uint64_t>((clock::now() - m_start) / resolution);
+	}
+
+	void timer_wheel::start()
+	{
+		schedule();
+	}
+
+	void timer_wheel::stop()
+	{
+		m_stopped = true;
+		m_timer.cancel();
+	}
+
+	void timer_wheel::schedule()
+	{
+		m_timer.expires_after(resolution);
+		m_timer.async_wait(bind_executor(m_strand, [this](error_code ec) {
+			if (ec || m_stopped)
+				return;
+			tick();
+			schedule();
+		}));
+	}
+
+	void timer_wheel::arm(connection& conn, std::chrono::milliseconds timeout)
+	{
+		// rounded up, plus the tick already under way
+		auto ticks = static_cast<uint64_t>((timeout + resolution - std::chrono::milliseconds { 1 }) / resolution) + 1;
+
+		std::lock_guard<std::mutex> lock { m_mtx };
+		auto deadline = now() + ticks;
+		conn.m_deadline = deadline;
+		// an earlier entry will move the connection, when it comes up
+		if (conn.m_wheel_entry && conn.m_wheel_entry <= deadline)
+			return;
+
+		m_slots[deadline % slots].push_back({ conn.weak_from_this(), deadline });
+		conn.m_wheel_entry = deadline;
+	}
+
+	void timer_wheel::disarm(connection& conn)
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		conn.m_deadline = 0;
+	}
+
+	void timer_wheel::tick()
+	{
+		std::vector<std::shared_ptr<connection>> expired;
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			auto current = now();
+			std::vector<entry> due;
+			while (m_current < current) {
+				++m_current;
+				due.clear();
+				std::swap(due, m_slots[m_current % slots]);
+
+				for (auto& item : due) {
+					auto conn = item.conn.lock();
+					if (!conn || conn->m_wheel_entry != item.tick)
+						continue;
+
+					if (item.tick > m_current) { // one of the next rounds
+						m_slots[m_current % slots].push_back(std::move(item));
+						continue;
+					}
+
+					conn->m_wheel_entry = 0;
+					auto deadline = conn->m_deadline;
+					if (!deadline)
+						continue;
+
+					if (deadline <= m_current) {
+						conn->m_deadline = 0;
+						expired.push_back(std::move(conn));
+						continue;
+					}
+
+					m_slots[deadline % slots].push_back({ conn, deadline });
+					conn->m_wheel_entry = deadline;
+				}
+			}
+		}
+
+		for (auto& conn : expired)
+			conn->expire();
 	}
 
-	connection::connection(io_service& io, connection_manager& manager)
-		: m_stream { io, this }
-		, m_connection_manager { manager }
+	threaded_connection::threaded_connection(io_service& io, connection_manager& manager, thread_pool& threads)
+		: connection { manager }
+		, m_io { io }
+		, m_threads { threads }
+		, m_stream { io, this }
 	{
-		LOG_DBG2() << "connection::connection(this:" << this << ")";
+		LOG_DBG2() << "threaded_connection::threaded_connection(this:" << this << ")";
 	}
 
-	connection::~connection()
+	threaded_connection::~threaded_connection()
 	{
-		LOG_DBG2() << "connection::~connection(this:" << this << ")";
+		LOG_DBG2() << "threaded_connection::~threaded_connection(this:" << this << ")";
 	}
 
-	void connection::start()
+	void threaded_connection::start()
 	{
-		LOG_DBG2() << "connection::start(this:" << this << ")";
+		LOG_DBG2() << "threaded_connection::start(this:" << this << ")";
+		// every read and write goes through the io_service, which should
+		// not run out of work before the handler loop is done with it
+		m_work.emplace(m_io.get_executor());
+		m_stream.opened();
+
 		auto shared = shared_from_this();
-		m_th = std::thread([this, shared] {
+		m_threads.post([this, shared] {
 			LOG_DBG2() << "START =============================================";
 			handle(false);
 			LOG_DBG2() << "STOP ----------------------------------------------";
+			m_work.reset();
 		});
 	}
 
-	void connection::handle(bool secure)
+	void threaded_connection::handle(bool secure)
 	{
 		stream io { m_stream };
 		m_connection_manager.on_connection(io, secure);
 	}
 
-	void connection::stop()
+	void threaded_connection::stop()
 	{
-		LOG_DBG2() << "connection::stop(this:" << this << ")";
-		auto shared = shared_from_this();
+		LOG_DBG2() << "threaded_connection::stop(this:" << this << ")";
+		// the handler loop notices the closed socket and returns the thread to the pool
 		m_stream.close();
-		m_stream.socket().get_io_service().post([this, shared] {
-			LOG_DBG2() << "connection::stop(this:" << this << ")::lambda -- "
-					  << (m_th.joinable() ? "" : "non ") << "joinable";
-			if (m_th.joinable())
-				m_th.join();
-			LOG_DBG2() << "connection::stop(this:" << this << ")::lambda/done";
+	}
+
+	bool async_connection::buffered_stream::overflow(stream* src, const void* data, size_t size, unsigned)
+	{
+		auto ptr = static_cast<const char*>(data);
+		m_parent->m_output.insert(m_parent->m_output.end(), ptr, ptr + size);
+		src->flushed_write();
+		return true;
+	}
+
+	bool async_connection::buffered_stream::writev(stream* src, const buffer_view* buffers, size_t count, unsigned)
+	{
+		auto& output = m_parent->m_output;
+		output.reserve(output.size() + total_size(buffers, count));
+		for (size_t i = 0; i < count; ++i) {
+			auto ptr = static_cast<const char*>(buffers[i].data);
+			output.insert(output.end(), ptr, ptr + buffers[i].size);
+		}
+		src->flushed_write();
+		return true;
+	}
+
+	bool async_connection::buffered_stream::can_send_file(stream*)
+	{
+		return has_sendfile();
+	}
+
+	bool async_connection::buffered_stream::send_file(stream*, int fd, uint64_t offset, uint64_t length, unsigned)
+	{
+#ifdef __linux__
+		// the response closes its file, before the write gets to it
+		auto copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+		if (copy < 0)
+			return false;
+		m_parent->m_files.push_back({ copy, offset, length, m_parent->m_output.size() });
+		return true;
+#else
+		(void)fd; (void)offset; (void)length;
+		return false;
+#endif
+	}
+
+	size_t async_connection::buffered_stream::read_some(stream*, void* data, size_t size, unsigned)
+	{
+		if (size > m_body_length)
+			size = m_body_length;
+
+		std::memcpy(data, m_body, size);
+		m_body += size;
+		m_body_length -= size;
+		return size;
+	}
+
+	async_connection::async_connection(io_service& io, connection_manager& manager, executor* workers)
+		: connection { manager }
+		, m_socket { io }
+		, m_strand { io }
+		, m_executor { workers }
+		, m_parser { m_arena.get(), manager.limits(), &m_base }
+	{
+		LOG_DBG2() << "async_connection::async_connection(this:" << this << ")";
+	}
+
+	async_connection::~async_connection()
+	{
+		LOG_DBG2() << "async_connection::~async_connection(this:" << this << ")";
+#ifdef __linux__
+		for (auto& file : m_files)
+			::close(file.fd);
+#endif
+	}
+
+	void async_connection::start()
+	{
+		LOG_DBG2() << "async_connection::start(this:" << this << ")";
+		error_code ec;
+		auto remote = m_socket.remote_endpoint(ec);
+		if (ec) {
+			shutdown();
+			return;
+		}
+		m_remote = { remote.address().to_string(), remote.port() };
+		m_local = { ip::host_name(), m_socket.local_endpoint(ec).port() };
+
+		auto shared = shared_from_this();
+		dispatch(m_strand, [this, shared] {
+			stage(io_stage::idle);
+			read_some();
 		});
 	}
 
-	void connection::shutdown()
+	void async_connection::stop()
 	{
-		LOG_DBG2() << "connection::shutdown(this:" << this << ")";
-		m_connection_manager.stop(shared_from_this());
+		LOG_DBG2() << "async_connection::stop(this:" << this << ")";
+		auto shared = shared_from_this();
+		dispatch(m_strand, [this, shared] {
+			error_code ec;
+			m_socket.close(ec);
+		});
+	}
+
+	void async_connection::read_some()
+	{
+		static constexpr size_t chunk = 8192;
+
+		auto offset = m_input.size();
+		m_input.resize(offset + chunk);
+
+		auto shared = shared_from_this();
+		m_socket.async_read_some(buffer(m_input.data() + offset, chunk),
+			bind_executor(m_strand, [this, shared, offset](error_code ec, std::size_t bytes_transferred) {
+				if (ec) {
+					m_input.resize(offset);
+					LOG_DBG2() << "async_connection::read_some(this:" << this << ") -- failed: " << ec.message();
+					shutdown();
+					return;
+				}
+
+				m_input.resize(offset + bytes_transferred);
+				LOG_DBG2() << "async_connection::read_some(this:" << this << ") --> " << bytes_transferred;
+				received();
+				if (!process())
+					read_some();
+			}));
+	}
+
+	parsing async_connection::parse_head()
+	{
+		auto ret = m_parser.parse(m_input.data(), m_input.size());
+		if (ret == parsing::separator) {
+			m_head_length = m_parser.head_length();
+			m_body_length = 0;
+			m_chunks = { };
+
+			// the bad ones are answered by server::on_request
+			auto length = m_parser.fields().find_front(header::Content_Length);
+			auto coding = m_parser.fields().find_front(header::Transfer_Encoding);
+			std::string_view length_view, coding_view;
+			if (length)
+				length_view = *length;
+			if (coding)
+				coding_view = *coding;
+			uint64_t size = 0;
+			auto framing = content_reader::framing_of(length ? &length_view : nullptr, coding ? &coding_view : nullptr, size);
+			m_chunked = framing == content_reader::framing::chunked;
+			m_expects = m_parser.fields().find_front(header::Expect).has_value();
+			m_decoded = 0;
+			// more than it would hold; answered without waiting for it
+			m_too_large = framing == content_reader::framing::length && size > m_connection_manager.max_content();
+			if (framing == content_reader::framing::length && !m_too_large)
+				m_body_length = static_cast<size_t>(size);
+
+			if (!body_received())
+				stage(io_stage::body);
+		}
+		return ret;
+	}
+
+	// The content is handed to the handler in one piece; the chunks are
+	// only walked here, to find the end of the last one, and decoded
+	// again as the handler reads them.
+	bool async_connection::body_received()
+	{
+		auto size = m_input.size() - m_head_length;
+		if (!m_chunked)
+			return size >= m_body_length;
+
+		auto data = m_input.data() + m_head_length;
+		auto max = m_connection_manager.max_content();
+		std::string_view chunk;
+		while (m_body_length < size && !m_chunks.done() && !m_chunks.failed() && m_decoded <= max) {
+			m_body_length += m_chunks.decode(data + m_body_length, size - m_body_length, chunk);
+			m_decoded += chunk.size();
+		}
+		// the framing may not take more than the content itself, e.g.
+		// with one byte chunks
+		m_too_large = m_decoded > max || (!m_chunks.done() && !m_chunks.failed() && size / 2 > max);
+		return m_chunks.done() || m_chunks.failed() || m_too_large;
+	}
+
+	// Returns true, if the connection moved on to writing (or closing)
+	// and false, if it needs more bytes from the socket.
+	bool async_connection::process()
+	{
+		if (!m_head_length) {
+			auto ret = parse_head();
+			if (ret == parsing::incomplete)
+				return false;
+			if (ret == parsing::line_too_long || ret == parsing::head_too_large) {
+				reject(ret);
+				return true;
+			}
+			if (ret != parsing::separator) {
+				LOG_DBG2() << "[CONN " << m_conn_no << "] ERROR";
+				shutdown();
+				return true;
+			}
+		}
+
+		if (!body_received()) {
+			// the client may wait for 100 Continue, before it sends more
+			if (m_expects && !m_parser.continued()) {
+				answer_expect();
+				return true;
+			}
+			return false;
+		}
+
+		if (m_too_large) {
+			reject(parsing::content_too_large);
+			return true;
+		}
+
+		serve();
+		return true;
+	}
+
+	// 414, 431 or 413, written after the responses already waiting
+	void async_connection::reject(parsing reason)
+	{
+		buffered_stream impl { this, nullptr, 0 };
+		stream io { impl };
+		io.conn_no(m_conn_no + 1);
+		m_connection_manager.on_rejected(io, m_parser, reason);
+		m_keep_alive = false;
+		stage(io_stage::reply);
+		write();
+	}
+
+	// Either 100 Continue followed by more reads, or the final response,
+	// e.g. a 404 or 413, without waiting for the content at all. The
+	// accept delegate of the route is user code, so with workers it runs
+	// on them, like the handlers in serve().
+	void async_connection::answer_expect()
+	{
+		m_parser.continued(true);
+		if (!m_executor) {
+			expect_answered(ask_expect(false));
+			return;
+		}
+
+		stage(io_stage::reply);
+		auto shared = shared_from_this();
+		auto queued = m_executor->post([this, shared] {
+			auto go_on = ask_expect(false);
+			post(m_strand, [this, shared, go_on] { expect_answered(go_on); });
+		});
+		if (queued)
+			return;
+
+		LOG_DBG2() << "async_connection::answer_expect(this:" << this << ") -- handler queue full";
+		expect_answered(ask_expect(true));
+	}
+
+	// false, if the final response is in m_output
+	bool async_connection::ask_expect(bool overloaded)
+	{
+		buffered_stream impl { this, nullptr, 0 };
+		stream io { impl };
+		m_parser.rebase(m_input.data());
+		io.conn_no(m_conn_no + 1);
+
+		// 503, and the content, which the client may send anyway, is not read
+		if (overloaded) {
+			m_connection_manager.on_overload(io, m_parser, false);
+			return false;
+		}
+		return m_connection_manager.on_expect(io, m_parser, false);
+	}
+
+	void async_connection::expect_answered(bool go_on)
+	{
+		if (!go_on) {
+			m_keep_alive = false;
+			stage(io_stage::reply);
+			write();
+			return;
+		}
+
+		if (m_output.empty()) {
+			stage(io_stage::body);
+			read_some();
+			return;
+		}
+
+		writing();
+		auto shared = shared_from_this();
+		async_write(m_socket, buffer(m_output),
+			bind_executor(m_strand, [this, shared](error_code ec, std::size_t) {
+				m_output.clear();
+				if (ec) {
+					LOG_DBG2() << "async_connection::expect_answered(this:" << this << ") -- failed: " << ec.message();
+					shutdown();
+					return;
+				}
+
+				stage(io_stage::body);
+				read_some();
+			}));
+	}
+
+	void async_connection::serve()
+	{
+		stage(io_stage::reply);
+		if (m_executor) {
+			// Nothing touches the buffers until the worker is done, there is
+			// no read in flight and the write starts from finish_request().
+			auto shared = shared_from_this();
+			auto queued = m_executor->post([this, shared] {
+				run_request(false);
+				post(m_strand, [this, shared] { finish_request(); });
+			});
+			if (queued)
+				return;
+
+			LOG_DBG2() << "async_connection::serve(this:" << this << ") -- handler queue full";
+			run_request(true);
+		} else {
+			run_request(false);
+		}
+
+		finish_request();
+	}
+
+	void async_connection::run_request(bool overloaded)
+	{
+		buffered_stream impl { this, m_input.data() + m_head_length, m_body_length };
+		stream io { impl };
+		m_parser.rebase(m_input.data()); // reading the content may have moved it
+		io.conn_no(++m_conn_no);
+
+		auto keep_alive = overloaded
+			? m_connection_manager.on_overload(io, m_parser, false)
+			: m_connection_manager.on_request(io, m_parser, false);
+		m_keep_alive = keep_alive && !impl.was_shut();
+	}
+
+	void async_connection::finish_request()
+	{
+		m_input.erase(m_input.begin(), m_input.begin() + static_cast<ptrdiff_t>(m_head_length + m_body_length));
+		m_parser = request_parser { m_arena.get(), m_connection_manager.limits(), &m_base };
+		m_arena.release();
+		m_head_length = 0;
+		m_body_length = 0;
+
+		// the next request is already here, its response joins this one
+		if (m_keep_alive && ++m_pipelined < m_connection_manager.pipeline_depth() &&
+			parse_head() == parsing::separator && body_received() && !m_too_large) {
+			serve();
+			return;
+		}
+
+		m_pipelined = 0;
+		write();
+	}
+
+	void async_connection::write()
+	{
+		// the bytes up to the next file, then the file itself
+		auto until = m_files.empty() ? m_output.size() : m_files.front().position;
+		if (m_written == until) {
+			if (!m_files.empty()) {
+				write_file();
+				return;
+			}
+
+			m_output.clear();
+			m_written = 0;
+			next();
+			return;
+		}
+
+		writing();
+		auto shared = shared_from_this();
+		async_write(m_socket, buffer(m_output.data() + m_written, until - m_written),
+			bind_executor(m_strand, [this, shared, until](error_code ec, std::size_t bytes_transferred) {
+				if (ec) {
+					LOG_DBG2() << "async_connection::write(this:" << this << ") -- failed: " << ec.message();
+					shutdown();
+					return;
+				}
+
+				LOG_DBG2() << "async_connection::write(this:" << this << ") --> " << bytes_transferred;
+				m_written = until;
+				write();
+			}));
+	}
+
+	void async_connection::write_file()
+	{
+		auto& file = m_files.front();
+		auto shared = shared_from_this();
+		async_send_file(*this, m_socket, m_strand, file.fd, file.offset, file.length, [this, shared](error_code ec) {
+#ifdef __linux__
+			::close(m_files.front().fd);
+#endif
+			m_files.erase(m_files.begin());
+			if (ec) {
+				LOG_DBG2() << "async_connection::write_file(this:" << this << ") -- failed: " << ec.message();
+				shutdown();
+				return;
+			}
+
+			write();
+		});
+	}
+
+	void async_connection::next()
+	{
+		if (!m_keep_alive) {
+			shutdown();
+			return;
+		}
+
+		// a head parsed by finish_request() waits for the rest of its content
+		if (m_head_length)
+			stage(io_stage::body);
+		else
+			stage(m_input.empty() ? io_stage::idle : io_stage::head);
+		if (!process())
+			read_some();
+	}
+
+	boost::context::stack_context stack_pool::allocate()
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		return m_stacks.allocate();
+	}
+
+	void stack_pool::deallocate(boost::context::stack_context& sctx) noexcept
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		m_stacks.deallocate(sctx);
+	}
+
+	void coroutine_connection::fiber_stream::shutdown(stream* src)
+	{
+		LOG_DBG2() << "fiber_stream::shutdown(this:" << this << ", src:" << src << ")";
+		m_parent->shutdown();
+	}
+
+	bool coroutine_connection::fiber_stream::overflow(stream* src, const void* data, size_t size, unsigned conn)
+	{
+		buffer_view buffer { data, size };
+		return writev(src, &buffer, 1, conn);
+	}
+
+	bool coroutine_connection::fiber_stream::writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn)
+	{
+		auto size = total_size(buffers, count);
+		LOG_DBG2() << "fiber_stream::writev(this:" << this << ", src:" << src << ", count:" << count << ", size:" << size << ")";
+
+		error_code result;
+		size_t transferred = 0;
+		m_parent->writing();
+		async_write(m_parent->m_socket, as_sequence(buffers, count),
+			bind_executor(m_parent->m_strand, [&, parent = m_parent, shared = m_parent->shared_from_this()](error_code ec, std::size_t bytes_transferred) {
+				result = ec;
+				transferred = bytes_transferred;
+				parent->resume();
+			}));
+		m_parent->yield();
+
+		if (result) {
+			LOG_DBG2() << "fiber_stream::writev(this:" << this << ", src:" << src << ", #" << conn << ") -- failed: " << result.message();
+			return false;
+		}
+
+		m_parent->written();
+		src->flushed_write();
+		return transferred == size;
+	}
+
+	bool coroutine_connection::fiber_stream::can_send_file(stream*)
+	{
+		return has_sendfile();
+	}
+
+	bool coroutine_connection::fiber_stream::send_file(stream* src, int fd, uint64_t offset, uint64_t length, unsigned conn)
+	{
+		LOG_DBG2() << "fiber_stream::send_file(this:" << this << ", src:" << src << ", fd:" << fd << ", length:" << length << ")";
+
+		error_code result;
+		async_send_file(*m_parent, m_parent->m_socket, m_parent->m_strand, fd, offset, length,
+			[&, parent = m_parent, shared = m_parent->shared_from_this()](error_code ec) {
+				result = ec;
+				parent->resume();
+			});
+		m_parent->yield();
+
+		if (result) {
+			LOG_DBG2() << "fiber_stream::send_file(this:" << this << ", src:" << src << ", #" << conn << ") -- failed: " << result.message();
+			return false;
+		}
+
+		m_parent->written();
+		return true;
+	}
+
+	void coroutine_connection::fiber_stream::stage(stream*, io_stage next)
+	{
+		m_parent->stage(next);
+	}
+
+	size_t coroutine_connection::fiber_stream::read_some(stream* src, void* data, size_t size, unsigned conn)
+	{
+		LOG_DBG2() << "fiber_stream::read_some(this:" << this << ", src:" << src << ", size:" << size << ")";
+
+		error_code result;
+		size_t transferred = 0;
+		m_parent->m_socket.async_read_some(buffer(data, size),
+			bind_executor(m_parent->m_strand, [&, parent = m_parent, shared = m_parent->shared_from_this()](error_code ec, std::size_t bytes_transferred) {
+				result = ec;
+				transferred = bytes_transferred;
+				parent->resume();
+			}));
+		m_parent->yield();
+
+		if (result) {
+			LOG_DBG2() << "fiber_stream::read_some(this:" << this << ", src:" << src << ", #" << conn << ") -- failed: " << result.message();
+			return 0;
+		}
+
+		if (transferred)
+			m_parent->received();
+		return transferred;
+	}
+
+	bool coroutine_connection::fiber_stream::is_open(stream*)
+	{
+		return m_parent->m_socket.is_open();
+	}
+
+	endpoint_t coroutine_connection::fiber_stream::remote_endpoint(stream*)
+	{
+		auto ep = m_parent->m_socket.remote_endpoint();
+		return { ep.address().to_string(), ep.port() };
+	}
+
+	endpoint_t coroutine_connection::fiber_stream::local_endpoint(stream*)
+	{
+		return { ip::host_name(), m_parent->m_socket.local_endpoint().port() };
+	}
+
+	coroutine_connection::coroutine_connection(io_service& io, connection_manager& manager, stack_pool& stacks)
+		: connection { manager }
+		, m_socket { io }
+		, m_strand { io }
+		, m_stacks { stacks }
+		, m_stream { this }
+	{
+		LOG_DBG2() << "coroutine_connection::coroutine_connection(this:" << this << ")";
+	}
+
+	coroutine_connection::~coroutine_connection()
+	{
+		LOG_DBG2() << "coroutine_connection::~coroutine_connection(this:" << this << ")";
+	}
+
+	void coroutine_connection::resume()
+	{
+		m_fiber = std::move(m_fiber).resume();
+	}
+
+	void coroutine_connection::yield()
+	{
+		m_caller = std::move(m_caller).resume();
+	}
+
+	void coroutine_connection::start()
+	{
+		LOG_DBG2() << "coroutine_connection::start(this:" << this << ")";
+		m_fiber = boost::context::fiber { std::allocator_arg, m_stacks.get_allocator(), [this](boost::context::fiber&& caller) {
+			m_caller = std::move(caller);
+			LOG_DBG2() << "START =============================================";
+			{
+				stream io { m_stream };
+				m_connection_manager.on_connection(io, false);
+			}
+			LOG_DBG2() << "STOP ----------------------------------------------";
+			return std::move(m_caller);
+		} };
+
+		auto shared = shared_from_this();
+		dispatch(m_strand, [this, shared] { resume(); });
+	}
+
+	void coroutine_connection::stop()
+	{
+		LOG_DBG2() << "coroutine_connection::stop(this:" << this << ")";
+		auto shared = shared_from_this();
+		dispatch(m_strand, [this, shared] {
+			error_code ec;
+			m_socket.close(ec);
+		});
 	}
 
 	void connection_manager::start(const std::shared_ptr<connection>& c)
 	{
 		LOG_DBG2() << "connection_manager::start(this:" << this << ", c:" << c.get() << ":" << c.use_count() << ")";
-		m_connections.insert(c);
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			m_connections.insert(c);
+			++m_accepted;
+		}
 		c->start();
 	}
 
 	void connection_manager::stop(const std::shared_ptr<connection>& c)
 	{
 		LOG_DBG2() << "connection_manager::stop(this:" << this << ", c:" << c.get() << ":" << c.use_count() << ")";
-		m_connections.erase(c);
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			m_connections.erase(c);
+		}
 		c->stop();
 	}
 
+	void connection_manager::expire(const std::shared_ptr<connection>& c)
+	{
+		LOG_DBG2() << "connection_manager::expire(this:" << this << ", c:" << c.get() << ":" << c.use_count() << ")";
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			if (!m_connections.erase(c))
+				return;
+			++m_timed_out;
+		}
+		c->stop();
+	}
+
+	shard_stats connection_manager::stats() const
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		return { m_connections.size(), m_accepted, m_timed_out };
+	}
+
 	void connection_manager::stop_all()
 	{
 		LOG_DBG2() << "connection_manager::stop_all(this:" << this << ")";
 		std::unordered_set<std::shared_ptr<connection>> local;
-		std::swap(local, m_connections);
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			std::swap(local, m_connections);
+		}
 		for (auto& c : local) {
 			LOG_DBG2() << "connection_manager::stop_all(this:" << this << ") -- c:" << c.get() << ":" << c.use_count();
 			c->stop();
 		}
 	}
 
-	service::service(delegate<void(stream&, bool)> onconnection)
-		: m_signals { m_service }
+	shard::shard(asio::execution mode, size_t stack_size, executor* workers, thread_pool* threads, const asio::timeouts& limits, size_t pipeline_depth, const callbacks& cb)
+		: m_strand { m_service }
 		, m_acceptor { m_service }
-		, m_manager { onconnection }
+		, m_wheel { m_service, m_strand }
+		, m_manager { cb, m_wheel, limits, pipeline_depth }
+		, m_execution { mode }
+		, m_executor { workers }
+		, m_threads { threads }
 	{
-		LOG_DBG2() << "service::service(this:" << this << ")";
-		m_signals.add(SIGINT);
-		m_signals.add(SIGTERM);
-#if defined(SIGQUIT)
-		m_signals.add(SIGQUIT);
-#endif // defined(SIGQUIT)
-		m_signals.async_wait([this](error_code /*ec*/, int /*signo*/)
-		{
-			// The server is stopped by cancelling all outstanding asynchronous
-			// operations. Once all operations have finished the io_service::run()
-			// call will exit.
-			printf("\nShutting the server down\n");
-			m_acceptor.close();
-			m_manager.stop_all();
-		});
+		LOG_DBG2() << "shard::shard(this:" << this << ")";
+		if (m_execution == asio::execution::coroutine)
+			m_stacks = std::make_unique<stack_pool>(stack_size ? stack_size : 256 * 1024);
 	}
 
-	service::~service() {
-		LOG_DBG2() << "service::~service(this:" << this << ")";
+	shard::~shard() {
+		LOG_DBG2() << "shard::~shard(this:" << this << ")";
 	}
 
-	endpoint service::setup(unsigned short port)
+	unsigned short shard::listen(const ip::tcp::endpoint& endpoint, bool reuse_port)
 	{
-		LOG_DBG2() << "service::setup(this:" << this << ", port:" << port << ")";
-
-		ip::tcp::resolver resolver(m_service);
-		ip::tcp::endpoint endpoint(ip::tcp::v4(), port);
+		LOG_DBG2() << "shard::listen(this:" << this << ", port:" << endpoint.port() << ")";
 
 		m_acceptor.open(endpoint.protocol());
 		m_acceptor.set_option(ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+		if (reuse_port)
+			m_acceptor.set_option(detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
 		m_acceptor.bind(endpoint);
 		m_acceptor.listen(socket_base::max_connections);
 
 		next_accept();
-		return web::asio::endpoint{ ip::host_name(), m_acceptor.local_endpoint().port() };
+		m_wheel.start();
+		return m_acceptor.local_endpoint().port();
+	}
+
+	void shard::stop()
+	{
+		dispatch(m_strand, [this] {
+			m_acceptor.close();
+			m_wheel.stop();
+			m_manager.stop_all();
+		});
+	}
+
+	std::shared_ptr<connection> shard::make_connection()
+	{
+		if (m_execution == asio::execution::async)
+			return std::make_shared<async_connection>(m_service, m_manager, m_executor);
+		if (m_execution == asio::execution::coroutine)
+			return std::make_shared<coroutine_connection>(m_service, m_manager, *m_stacks);
+		return std::make_shared<threaded_connection>(m_service, m_manager, *m_threads);
 	}
 
-	void service::next_accept()
+	void shard::next_accept()
 	{
-		auto conn = std::make_shared<connection>(m_service, m_manager);
-		LOG_DBG2() << "service::next_accept(this:" << this << ") -- conn:" << conn.get() << ":" << conn.use_count();
-		m_acceptor.async_accept(conn->socket(), [this, conn](error_code ec) {
+		auto conn = make_connection();
+		LOG_DBG2() << "shard::next_accept(this:" << this << ") -- conn:" << conn.get() << ":" << conn.use_count();
+		m_acceptor.async_accept(conn->socket(), bind_executor(m_strand, [this, conn](error_code ec) {
 			if (!m_acceptor.is_open()) {
-				LOG_DBG2() << "service::next_accept(this:" << this << ")::lambda -- acceptor closed";
+				LOG_DBG2() << "shard::next_accept(this:" << this << ")::lambda -- acceptor closed";
 				return;
 			}
 
 			if (ec) {
-				LOG_ERR() << "service::next_accept(this:" << this << ")::lambda -- acceptor error: " << ec.message();
+				LOG_ERR() << "shard::next_accept(this:" << this << ")::lambda -- acceptor error: " << ec.message();
 				return;
 			}
 
-			LOG_DBG2() << "service::next_accept(this:" << this << ")::lambda -- starting conn:" << conn.get() << ":" << conn.use_count();
+			LOG_DBG2() << "shard::next_accept(this:" << this << ")::lambda -- starting conn:" << conn.get() << ":" << conn.use_count();
 			m_manager.start(conn);
 
 			next_accept();
+		}));
+	}
+
+	service::service(const callbacks& cb)
+		: m_callbacks { cb }
+	{
+		LOG_DBG2() << "service::service(this:" << this << ")";
+	}
+
+	service::~service() {
+		LOG_DBG2() << "service::~service(this:" << this << ")";
+	}
+
+	endpoint service::setup(unsigned short port)
+	{
+		LOG_DBG2() << "service::setup(this:" << this << ", port:" << port << ")";
+
+		auto count = size_t { 1 };
+#ifdef SO_REUSEPORT
+		if (m_sharded)
+			count = threads();
+#else
+		if (m_sharded)
+			LOG_WRN() << "service::setup(this:" << this << ") -- no SO_REUSEPORT, using a single acceptor";
+#endif
+
+		m_shards.clear();
+		m_executor.reset();
+		m_connection_threads.reset();
+		if (m_execution == asio::execution::threaded)
+			m_connection_threads = std::make_unique<thread_pool>(m_max_threads, m_stack_size);
+		if (m_workers) {
+			if (m_execution == asio::execution::async)
+				m_executor = std::make_unique<executor>(m_workers, m_queue_depth ? m_queue_depth : 16 * m_workers);
+			else
+				LOG_WRN() << "service::setup(this:" << this << ") -- handler workers need the async execution, ignoring";
+		}
+
+		m_shards.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			m_shards.push_back(std::make_unique<shard>(m_execution, m_stack_size, m_executor.get(), m_connection_threads.get(), m_timeouts, m_pipeline_depth, m_callbacks));
+			// all shards must agree on a port, even if the first one was given 0
+			port = m_shards.back()->listen({ ip::tcp::v4(), port }, count > 1);
+		}
+
+		m_signals = std::make_unique<signal_set>(m_shards.front()->get_io_service());
+		m_signals->add(SIGINT);
+		m_signals->add(SIGTERM);
+#if defined(SIGQUIT)
+		m_signals->add(SIGQUIT);
+#endif // defined(SIGQUIT)
+		m_signals->async_wait([this](error_code /*ec*/, int /*signo*/)
+		{
+			// The server is stopped by cancelling all outstanding asynchronous
+			// operations. Once all operations have finished the io_service::run()
+			// call will exit.
+			printf("\nShutting the server down\n");
+			for (auto& shard : m_shards)
+				shard->stop();
 		});
+
+		return web::asio::endpoint{ ip::host_name(), port };
+	}
+
+	size_t service::threads() const
+	{
+		if (m_threads)
+			return m_threads;
+		auto cores = std::thread::hardware_concurrency();
+		return cores ? cores : 1;
+	}
+
+	std::vector<shard_stats> service::stats() const
+	{
+		std::vector<shard_stats> out;
+		out.reserve(m_shards.size());
+		for (auto& shard : m_shards)
+			out.push_back(shard->stats());
+		return out;
+	}
+
+	namespace {
+		void pin_to_core(std::thread& th, size_t core)
+		{
+#ifdef __linux__
+			auto cores = std::thread::hardware_concurrency();
+			if (!cores)
+				return;
+
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(core % cores, &set);
+			if (pthread_setaffinity_np(th.native_handle(), sizeof(set), &set))
+				LOG_WRN() << "pin_to_core(core:" << core << ") -- failed";
+#else
+			(void)th;
+			(void)core;
+#endif
+		}
+	}
+
+	void service::run()
+	{
+		if (m_shards.empty())
+			return;
+
+		std::vector<std::thread> pool;
+		if (m_shards.size() > 1) {
+			pool.reserve(m_shards.size());
+			for (auto& shard : m_shards) {
+				pool.emplace_back([ptr = shard.get()] { ptr->run(); });
+				pin_to_core(pool.back(), pool.size() - 1);
+			}
+		} else {
+			auto& shard = *m_shards.front();
+			auto count = threads();
+			pool.reserve(count - 1);
+			for (size_t i = 1; i < count; ++i)
+				pool.emplace_back([&] { shard.run(); });
+
+			shard.run();
+		}
+
+		for (auto& th : pool)
+			th.join();
+
+		if (m_executor)
+			m_executor->stop();
+		if (m_connection_threads)
+			m_connection_threads->stop();
 	}
 }}
 
 namespace web {
 	server::server()
-		: m_svc { { this, &server::on_connection } }
+		: m_svc { { { this, &server::on_connection }, { this, &server::on_request }, { this, &server::on_overload }, { this, &server::on_expect }, { this, &server::on_rejected }, { this, &server::max_content }, { this, &server::limits } } }
 	{
 	}
 
@@ -280,9 +1376,75 @@ namespace web {
 		m_svc.server(name);
 	}
 
-	std::optional<endpoint> server::listen(unsigned short port)
+	void server::set_execution(asio::execution mode)
+	{
+		m_svc.execution(mode);
+	}
+
+	void server::set_threads(size_t count)
+	{
+		m_svc.threads(count);
+	}
+
+	void server::set_stack_size(size_t size)
+	{
+		m_svc.stack_size(size);
+	}
+
+	void server::set_workers(size_t count, size_t queue_depth)
+	{
+		m_svc.workers(count, queue_depth);
+	}
+
+	void server::set_timeouts(const timeouts& limits)
+	{
+		m_svc.timeouts(limits);
+	}
+
+	void server::set_pipeline_depth(size_t depth)
+	{
+		m_svc.pipeline_depth(depth);
+	}
+
+	void server::set_max_threads(size_t count)
+	{
+		m_svc.max_threads(count);
+	}
+
+	void server::set_sharded(bool sharded)
+	{
+		m_svc.sharded(sharded);
+	}
+
+	std::vector<asio::shard_stats> server::stats() const
+	{
+#ifdef HTTP_USE_URING
+		if (m_uring)
+			return m_uring->stats();
+#endif
+		return m_svc.stats();
+	}
+
+	std::optional<endpoint> server::listen(unsigned short port, backend which)
 	{
 		try {
+#ifdef HTTP_USE_URING
+			m_uring.reset();
+			if (which == backend::io_uring) {
+				try {
+					m_uring = std::make_unique<uring::service>(
+						asio::callbacks { { this, &server::on_connection }, { this, &server::on_request }, { this, &server::on_overload }, { this, &server::on_expect }, { this, &server::on_rejected }, { this, &server::max_content }, { this, &server::limits } },
+						m_svc.threads(), m_svc.stack_size(), m_svc.timeouts());
+					return m_uring->setup(port);
+				} catch (std::system_error& e) {
+					LOG_WRN() << "server::listen(): io_uring is not available (" << e.what() << "), using asio";
+					m_uring.reset();
+				}
+			}
+#else
+			if (which == backend::io_uring)
+				LOG_WRN() << "server::listen(): built without io_uring, using asio";
+#endif
 			return m_svc.setup(port);
 		} catch (std::exception& e) {
 			fprintf(stderr, "server::listen(): exception: %s\n", e.what());
@@ -292,6 +1454,12 @@ namespace web {
 
 	void server::run()
 	{
+#ifdef HTTP_USE_URING
+		if (m_uring) {
+			m_uring->run();
+			return;
+		}
+#endif
 		m_svc.run();
 	}
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#include <web/executor.h>
+
+namespace web {
+	executor::executor(size_t workers, size_t capacity)
+		: m_queue(capacity ? capacity : 1)
+	{
+		m_workers.reserve(workers);
+		for (size_t i = 0; i < workers; ++i)
+			m_workers.emplace_back([this] { work(); });
+	}
+
+	executor::~executor()
+	{
+		stop();
+	}
+
+	bool executor::post(job&& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			if (m_stopped || m_count == m_queue.size())
+				return false;
+
+			m_queue[(m_head + m_count) % m_queue.size()] = std::move(task);
+			++m_count;
+		}
+		m_cv.notify_one();
+		return true;
+	}
+
+	void executor::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			m_stopped = true;
+		}
+		m_cv.notify_all();
+
+		for (auto& th : m_workers) {
+			if (th.joinable())
+				th.join();
+		}
+		m_workers.clear();
+	}
+
+	size_t executor::pending() const
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		return m_count;
+	}
+
+	void executor::work()
+	{
+		while (true) {
+			job task;
+			{
+				std::unique_lock<std::mutex> lock { m_mtx };
+				m_cv.wait(lock, [this] { return m_stopped || m_count; });
+				// jobs already queued are still run, so their connections
+				// get their responses (or at least their shared_ptrs back)
+				if (!m_count)
+					return;
+
+				task = std::move(m_queue[m_head]);
+				m_head = (m_head + 1) % m_queue.size();
+				--m_count;
+			}
+			task();
+		}
+	}
+}
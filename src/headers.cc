@@ -4,16 +4,18 @@
  */
 
 #include <web/headers.h>
-#include <cctype>
 #include <algorithm>
+#include <array>
+#include <cstdint>
 
 namespace web {
-	header_key header_key::make(std::string s)
-	{
-		static constexpr struct {
-			const char* name;
+	namespace {
+		struct known_header {
+			std::string_view name; // lower-case
 			header value;
-		} headers[] = {
+		};
+
+		constexpr known_header known[] = {
 			{ "accept", header::Accept },
 			{ "accept-charset", header::Accept_Charset },
 			{ "accept-encoding", header::Accept_Encoding },
@@ -65,22 +67,90 @@ namespace web {
 			{ "www-authenticate", header::WWW_Authenticate },
 		};
 
-		for (auto& c : s)
-			c = std::tolower((uint8_t)c);
+		constexpr size_t known_count = sizeof(known) / sizeof(known[0]);
+		constexpr size_t longest_name = 19; // if-unmodified-since
+		constexpr uint8_t no_slot = 0xFF;
+
+		constexpr char lower(char c)
+		{
+			return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+		}
+
+		// The length, the first and the last letter tell the known names
+		// apart; the coefficients were searched for, so that none of them
+		// share a slot.
+		constexpr size_t slot(size_t length, char first, char last)
+		{
+			return (length * 15 + static_cast<uint8_t>(lower(first)) * 24 + static_cast<uint8_t>(lower(last)) * 8) & 127;
+		}
+
+		constexpr std::array<uint8_t, 128> make_slots()
+		{
+			std::array<uint8_t, 128> out { };
+			for (auto& index : out)
+				index = no_slot;
+			for (size_t i = 0; i < known_count; ++i) {
+				auto& name = known[i].name;
+				out[slot(name.length(), name.front(), name.back())] = static_cast<uint8_t>(i);
+			}
+			return out;
+		}
+
+		constexpr auto slots = make_slots();
 
-		auto it = std::lower_bound(std::begin(headers), std::end(headers), s, [](const auto& h, const auto& s) {
-			return h.name < s;
-		});
+		constexpr bool every_name_has_its_slot()
+		{
+			for (size_t i = 0; i < known_count; ++i) {
+				auto& name = known[i].name;
+				if (slots[slot(name.length(), name.front(), name.back())] != i || name.length() > longest_name)
+					return false;
+			}
+			return true;
+		}
 
-		if (it != std::end(headers)) {
-			if (it->name == s) {
-				return it->value;
+		static_assert(every_name_has_its_slot(), "two known header names share a slot, search for new coefficients");
+
+		bool equal_lower(std::string_view raw, std::string_view lower_case)
+		{
+			if (raw.length() != lower_case.length())
+				return false;
+			for (size_t i = 0; i < raw.length(); ++i) {
+				if (lower(raw[i]) != lower_case[i])
+					return false;
 			}
+			return true;
 		}
+	}
 
+	header header_key::classify(std::string_view name) noexcept
+	{
+		if (name.empty() || name.length() > longest_name)
+			return header::extension_header;
+
+		auto index = slots[slot(name.length(), name.front(), name.back())];
+		if (index == no_slot || !equal_lower(name, known[index].name))
+			return header::extension_header;
+		return known[index].value;
+	}
+
+	header_key header_key::make(std::string s)
+	{
+		auto value = classify(s);
+		if (value != header::extension_header)
+			return value;
+
+		for (auto& c : s)
+			c = lower(c);
 		return s;
 	}
 
+	bool header_key::matches(std::string_view raw) const
+	{
+		if (m_header != header::extension_header)
+			return classify(raw) == m_header;
+		return equal_lower(raw, m_extension);
+	}
+
 	const char* header_key::name(header h)
 	{
 		switch (h) {
@@ -151,4 +221,65 @@ namespace web {
 
 		return nullptr;
 	}
+
+	void headers::add(const header_key& key, std::string_view value)
+	{
+		m_fields.push_back({ key, std::pmr::string { value, m_fields.get_allocator() } });
+		if (key.extension_header() || key.empty())
+			return;
+
+		auto& first = m_first[static_cast<size_t>(key.value())];
+		if (!first)
+			first = static_cast<uint32_t>(m_fields.size());
+	}
+
+	void headers::erase(const header_key& key)
+	{
+		if (!key.extension_header() && !m_first[static_cast<size_t>(key.value())])
+			return;
+
+		auto it = std::remove_if(m_fields.begin(), m_fields.end(), [&](const field& fld) { return fld.key == key; });
+		if (it == m_fields.end())
+			return;
+		m_fields.erase(it, m_fields.end());
+
+		// the fields after the erased ones moved
+		m_first.fill(0);
+		for (size_t pos = 0; pos < m_fields.size(); ++pos) {
+			auto& fld = m_fields[pos];
+			if (fld.key.extension_header() || fld.key.empty())
+				continue;
+			auto& first = m_first[static_cast<size_t>(fld.key.value())];
+			if (!first)
+				first = static_cast<uint32_t>(pos + 1);
+		}
+	}
+
+	const std::pmr::string* headers::find_front(const header_key& key) const
+	{
+		if (!key.extension_header()) {
+			auto first = m_first[static_cast<size_t>(key.value())];
+			return first ? &m_fields[first - 1].value : nullptr;
+		}
+
+		for (auto& fld : m_fields) {
+			if (fld.key == key)
+				return &fld.value;
+		}
+		return nullptr;
+	}
+
+	const std::string_view* request_headers::find_front(const header_key& key) const
+	{
+		if (!key.extension_header()) {
+			auto first = m_first[static_cast<size_t>(key.value())];
+			return first ? &m_fields[first - 1].value : nullptr;
+		}
+
+		for (auto& fld : m_fields) {
+			if (fld.key == header::extension_header && key.matches(fld.name))
+				return &fld.value;
+		}
+		return nullptr;
+	}
 }
@@ -3,6 +3,7 @@
 #include <chrono>
 #include <cstring>
 #include <iomanip>
+#include <memory>
 
 #ifdef POSIX
 // #include <sys/types.h>
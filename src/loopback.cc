@@ -0,0 +1,111 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#include <web/loopback.h>
+#include <cstring>
+
+namespace web {
+	void loopback::push(std::string_view bytes)
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		if (m_input_pos == m_input.size()) {
+			m_input.clear();
+			m_input_pos = 0;
+		}
+		m_input.append(bytes);
+		m_cv.notify_all();
+	}
+
+	void loopback::close_input()
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		m_input_closed = true;
+		m_cv.notify_all();
+	}
+
+	std::string loopback::take_output()
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		return std::move(m_output);
+	}
+
+	std::string loopback::take_output(size_t size)
+	{
+		std::unique_lock<std::mutex> lock { m_mtx };
+		m_cv.wait(lock, [&] { return m_output.size() >= size || m_shut; });
+		return std::move(m_output);
+	}
+
+	bool loopback::was_shut()
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		return m_shut;
+	}
+
+	void loopback::reset()
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		m_input.clear();
+		m_input_pos = 0;
+		m_input_closed = false;
+		m_output.clear();
+		m_shut = false;
+	}
+
+	void loopback::shutdown(stream*)
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		m_shut = true;
+		m_cv.notify_all();
+	}
+
+	bool loopback::overflow(stream* src, const void* data, size_t size, unsigned)
+	{
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			if (m_shut)
+				return false;
+			m_output.append(static_cast<const char*>(data), size);
+			m_cv.notify_all();
+		}
+		src->flushed_write();
+		return true;
+	}
+
+	bool loopback::writev(stream* src, const buffer_view* buffers, size_t count, unsigned)
+	{
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			if (m_shut)
+				return false;
+			for (size_t i = 0; i < count; ++i)
+				m_output.append(static_cast<const char*>(buffers[i].data), buffers[i].size);
+			m_cv.notify_all();
+		}
+		src->flushed_write();
+		return true;
+	}
+
+	size_t loopback::read_some(stream*, void* data, size_t size, unsigned)
+	{
+		std::unique_lock<std::mutex> lock { m_mtx };
+		m_cv.wait(lock, [&] { return m_input_pos < m_input.size() || m_input_closed || m_shut; });
+		if (m_shut)
+			return 0;
+
+		auto rest = m_input.size() - m_input_pos;
+		if (size > rest)
+			size = rest;
+		std::memcpy(data, m_input.data() + m_input_pos, size);
+		m_input_pos += size;
+		return size;
+	}
+
+	bool loopback::is_open(stream*)
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		return !m_shut;
+	}
+}
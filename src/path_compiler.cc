@@ -64,7 +64,7 @@ namespace web {
 		return escape<isGroup>(s);
 	}
 
-	inline static std::vector<key_type> parse_matcher(const std::string& mask)
+	std::vector<key_type> parse_matcher(const std::string& mask)
 	{
 #if 1
 		static const std::regex path_regex {
@@ -266,10 +266,10 @@ namespace web {
 		return make(description::make(mask, options), options);
 	}
 
-	bool matcher_type::matches(const std::string& route, std::vector<param>& params) const
+	bool matcher_type::matches(std::string_view route, std::pmr::vector<param>& params) const
 	{
-		std::smatch match;
-		auto matched = std::regex_match(route, match, regex);
+		std::match_results<std::string_view::const_iterator> match;
+		auto matched = std::regex_match(route.begin(), route.end(), match, regex);
 		if (!matched)
 			return false;
 
@@ -278,7 +278,11 @@ namespace web {
 
 		size_t id = 0;
 		for (auto& key : keys) {
-			params.push_back({ key.svalue, key.nvalue, match[++id] });
+			auto& sub = match[++id];
+			std::string_view value { };
+			if (sub.matched)
+				value = { route.data() + (sub.first - route.begin()), static_cast<size_t>(sub.length()) };
+			params.push_back({ key.svalue, key.nvalue, value });
 		}
 
 		return true;
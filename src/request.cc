@@ -4,8 +4,11 @@
  */
 
 #include <web/request.h>
+#include <web/stream.h>
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <cstring>
 
 namespace web {
 	method make_method(std::string& textual)
@@ -35,7 +38,194 @@ namespace web {
 		return method::other;
 	}
 
-	const std::string* request::find_param(const std::string& key) const
+	content_reader::framing content_reader::framing_of(const std::string_view* length, const std::string_view* coding, uint64_t& size)
+	{
+		size = 0;
+		if (coding) {
+			if (length)
+				return framing::bad_length;
+
+			auto value = *coding;
+			while (!value.empty() && std::isspace((uint8_t)value.front()))
+				value.remove_prefix(1);
+			while (!value.empty() && std::isspace((uint8_t)value.back()))
+				value.remove_suffix(1);
+
+			constexpr std::string_view chunked = "chunked";
+			auto same = value.length() == chunked.length() &&
+				std::equal(value.begin(), value.end(), chunked.begin(),
+					[](char lhs, char rhs) { return std::tolower((uint8_t)lhs) == rhs; });
+			return same ? framing::chunked : framing::bad_coding;
+		}
+
+		if (!length)
+			return framing::none;
+
+		auto end = length->data() + length->length();
+		auto [ptr, ec] = std::from_chars(length->data(), end, size);
+		if (length->empty() || ec != std::errc { } || ptr != end)
+			return framing::bad_length;
+		return framing::length;
+	}
+
+	bool content_reader::expects_continue(const request_headers& fields, http_version_t version)
+	{
+		// HTTP/1.0 clients do not know 100 Continue
+		auto expect = fields.find_front(header::Expect);
+		if (!expect || version != http_version::http_1_1)
+			return false;
+
+		constexpr std::string_view continue_100 = "100-continue";
+		return expect->length() == continue_100.length() &&
+			std::equal(expect->begin(), expect->end(), continue_100.begin(),
+				[](char lhs, char rhs) { return std::tolower((uint8_t)lhs) == rhs; });
+	}
+
+	content_reader::framing content_reader::open(const request_headers& fields, http_version_t version)
+	{
+		auto type = framing_of(fields.find_front(header::Content_Length), fields.find_front(header::Transfer_Encoding), m_left);
+		m_chunked = type == framing::chunked;
+		m_done = !m_chunked && !m_left;
+		m_expect = !m_done && expects_continue(fields, version);
+		return type;
+	}
+
+	bool content_reader::send_continue()
+	{
+		m_expect = false;
+		constexpr std::string_view line = "HTTP/1.1 100 Continue\r\n\r\n";
+		return m_io.write(line.data(), line.length()) == line.length() && m_io.flush() && m_io.send_held();
+	}
+
+	// the content is asked for, as soon as somebody reads it
+	bool content_reader::invite()
+	{
+		if (!m_expect || send_continue())
+			return true;
+		m_failed = true;
+		m_done = true;
+		return false;
+	}
+
+	bool content_reader::fill()
+	{
+		if (!invite())
+			return false;
+
+		// the body timeout is for the reads, not for the handler
+		m_io.stage(io_stage::body);
+		auto received = m_io.fill();
+		m_io.stage(io_stage::reply);
+		if (!received) {
+			m_failed = true;
+			m_done = true;
+		}
+		return received;
+	}
+
+	bool content_reader::fits(uint64_t more)
+	{
+		if (more <= m_max - m_read)
+			return true;
+		m_too_large = true;
+		m_failed = true;
+		m_done = true;
+		return false;
+	}
+
+	std::string_view content_reader::next(size_t limit)
+	{
+		if (!m_chunked && !m_done && !fits(m_left))
+			return { };
+
+		while (!m_done) {
+			auto [data, size] = m_io.peek();
+			if (!size) {
+				if (!fill())
+					break;
+				continue;
+			}
+
+			if (!m_chunked) {
+				auto chunk = static_cast<size_t>(std::min({ static_cast<uint64_t>(size), static_cast<uint64_t>(limit), m_left }));
+				m_io.consume(chunk);
+				m_left -= chunk;
+				m_read += chunk;
+				m_done = !m_left;
+				return { data, chunk };
+			}
+
+			std::string_view body;
+			m_io.consume(m_chunks.decode(data, size, body, limit));
+			if (m_chunks.failed())
+				m_failed = true;
+			m_done = m_chunks.done() || m_chunks.failed();
+			if (!body.empty()) {
+				if (!fits(body.size()))
+					break;
+				m_read += body.size();
+				return body;
+			}
+		}
+		return { };
+	}
+
+	size_t content_reader::read(void* data, size_t size)
+	{
+		if (!size)
+			return 0;
+
+		// nothing buffered, a known length lands in the caller's memory
+		if (!m_chunked && !m_done && !std::get<1>(m_io.peek())) {
+			if (!fits(m_left))
+				return 0;
+			if (!invite())
+				return 0;
+			m_io.stage(io_stage::body);
+			auto received = m_io.read_some(data, static_cast<size_t>(std::min(static_cast<uint64_t>(size), m_left)));
+			m_io.stage(io_stage::reply);
+			m_left -= received;
+			m_read += received;
+			m_failed = !received;
+			m_done = !m_left || m_failed;
+			return received;
+		}
+
+		auto chunk = next(size);
+		if (!chunk.empty())
+			std::memcpy(data, chunk.data(), chunk.size());
+		return chunk.size();
+	}
+
+	bool content_reader::read_all(std::pmr::vector<char>& dst)
+	{
+		if (!m_chunked && !over_limit())
+			dst.reserve(dst.size() + static_cast<size_t>(m_left));
+
+		while (!m_done) {
+			auto chunk = next(SIZE_MAX);
+			dst.insert(dst.end(), chunk.begin(), chunk.end());
+		}
+		return !m_failed;
+	}
+
+	bool content_reader::skip()
+	{
+		if (m_expect && !m_done)
+			return false;
+		while (!m_done)
+			next(SIZE_MAX);
+		return !m_failed;
+	}
+
+	const std::pmr::vector<char>& request::payload() const
+	{
+		if (m_content && !m_content->done())
+			m_content->read_all(m_payload);
+		return m_payload;
+	}
+
+	const std::string_view* request::find_param(std::string_view key) const
 	{
 		for (auto& p : m_params) {
 			if (!p.sname.empty() && p.sname == key)
@@ -44,7 +234,7 @@ namespace web {
 		return nullptr;
 	}
 
-	const std::string* request::find_param(size_t key) const
+	const std::string_view* request::find_param(size_t key) const
 	{
 		for (auto& p : m_params) {
 			if (p.sname.empty() && p.nname == key)
@@ -59,13 +249,11 @@ namespace web {
 		if (ct && *ct != "application/x-www-form-urlencoded")
 			return map;
 
-		auto const payload = std::string_view{ m_payload.data(), m_payload.size() };
-		auto items = uri::query_builder::parse(payload).items();
-		for (auto& [key, values] : items) {
-			if (values.empty())
-				map[std::move(key)];
-			else
-				map[std::move(key)] = std::move(values.front());
+		auto const& content = payload();
+		std::string name, value;
+		for (auto& field : query_view { { content.data(), content.size() } }) {
+			// the first value of a name is kept
+			map.try_emplace(std::string { query_view::decode(field.name, name) }, query_view::decode(field.value, value));
 		}
 
 		return map;
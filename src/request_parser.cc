@@ -5,8 +5,10 @@
 
 #include <web/request_parser.h>
 #include <web/request.h>
+#include <web/bits/scan.h>
 #include <algorithm>
 #include <cctype>
+#include <cstring>
 
 namespace web {
 	namespace {
@@ -38,9 +40,9 @@ namespace web {
 			return s;
 		}
 
-		std::string produce(const std::string& cs_)
+		std::string produce(std::string_view cs_)
 		{
-			auto ptr = cs_.c_str();
+			auto ptr = cs_.data();
 			auto len = cs_.length();
 			auto end = ptr + len;
 
@@ -53,6 +55,10 @@ namespace web {
 				--len;
 			}
 
+			// only folded values have a CRLF left after trimming
+			if (scan::find(ptr, end, '\r') == end)
+				return { ptr, len };
+
 			bool in_cont = false;
 			for (auto cur = ptr; cur != end; ++cur) {
 				uint8_t uc = *cur;
@@ -102,6 +108,26 @@ namespace web {
 			return out;
 		}
 
+		// the value without the surrounding whitespace; folded values are
+		// unfolded onto the arena
+		std::string_view trimmed(std::string_view raw, std::pmr::memory_resource& arena)
+		{
+			auto ptr = raw.data();
+			auto end = ptr + raw.length();
+			while (ptr != end && std::isspace((uint8_t)*ptr))
+				++ptr;
+			while (ptr != end && std::isspace((uint8_t)end[-1]))
+				--end;
+
+			if (scan::find(ptr, end, '\r') == end)
+				return { ptr, static_cast<size_t>(end - ptr) };
+
+			auto folded = produce({ ptr, static_cast<size_t>(end - ptr) });
+			auto copy = static_cast<char*>(arena.allocate(folded.length(), 1));
+			std::memcpy(copy, folded.data(), folded.length());
+			return { copy, folded.length() };
+		}
+
 		std::string lower(std::string&& in)
 		{
 			for (auto& c : in)
@@ -152,11 +178,14 @@ namespace web {
 #undef TEST_CHAR
 	}
 
-	parsing field_parser::read_line(data_src& src, std::vector<char>& dst)
+	parsing field_parser::read_line(data_src& src, std::pmr::vector<char>& dst, size_t max)
 	{
 		bool slashr = false;
+		size_t length = 0;
 		while (true) {
 			char c = 0;
+			if (++length > max)
+				return parsing::head_too_large;
 			if (!src.get(&c, 1))
 				return parsing::error;
 			dst.push_back(c);
@@ -173,111 +202,212 @@ namespace web {
 		}
 	}
 
-	parsing field_parser::decode(data_src& src)
+	parsing field_parser::parse(const char* data, size_t size, size_t& offset, size_t max_fields)
 	{
-		while (true) { // will return on error or separator
-			auto ret = read_line(src, m_contents);
-			if (ret != parsing::separator)
-				return ret;
-
-			auto begin = std::begin(m_contents);
-			auto cur = std::next(begin, m_last_line_end);
-			auto end = std::end(m_contents);
-
-			while (cur != end) {
-				auto it = std::find(cur, end, '\r');
-				if (it == end) break;
-				if (std::next(it) == end) break;
-				if (*std::next(it) != '\n') // mid-line \r? - check with RFC if ignore, or error
+		auto end = data + size;
+		while (offset < size) {
+			auto cur = data + offset;
+			const char* cr = nullptr;
+			const char* colon = nullptr;
+
+			if (*cur == '\r') // empty line
+				cr = cur;
+			else if (isspace((uint8_t)*cur)) {
+				if (m_field_list.empty())
 					return parsing::error;
+				cr = scan::find(cur, end, '\r');
+			} else {
+				colon = scan::find_non_token(cur, end);
+				if (colon == end)
+					return parsing::incomplete;
+				if (*colon != ':' || colon == cur) // no colon in field's first line, or not a token before it
+					return parsing::error;
+				cr = scan::find(colon + 1, end, '\r');
+			}
 
-				if (it == cur) { // empty line
-					return parsing::separator;
-				}
+			if (cr == end || cr + 1 == end)
+				return parsing::incomplete;
+			if (cr[1] != '\n') // mid-line \r? - check with RFC if ignore, or error
+				return parsing::error;
 
-				std::advance(it, 2);
-				if (isspace((uint8_t)*cur)) {
-					if (m_field_list.empty())
-						return parsing::error;
-
-					m_last_line_end = std::distance(begin, it);
-					auto& fld = std::get<1>(m_field_list.back());
-					fld = span(fld.offset(), m_last_line_end - fld.offset());
-				} else {
-					auto colon = std::find(cur, it, ':');
-					if (colon == it) // no colon in field's first line
-						return parsing::error;
-
-					m_last_line_end = std::distance(begin, it);
-					m_field_list.emplace_back(
-						span(std::distance(begin, cur), std::distance(cur, colon)),
-						span(std::distance(begin, colon) + 1, std::distance(colon, it) - 1)
-					);
-				}
+			auto line_end = static_cast<size_t>(cr - data) + 2;
+			if (cr == cur) {
+				offset = line_end;
+				return parsing::separator;
+			}
 
-				cur = it;
+			if (!colon) {
+				auto& fld = std::get<1>(m_field_list.back());
+				fld = span(fld.offset(), line_end - fld.offset());
+			} else {
+				if (max_fields && m_field_list.size() == max_fields)
+					return parsing::head_too_large;
+				auto value = static_cast<size_t>(colon - data) + 1;
+				m_field_list.emplace_back(
+					span(offset, static_cast<size_t>(colon - cur)),
+					span(value, line_end - value)
+				);
 			}
+
+			offset = line_end;
 		}
+		return parsing::incomplete;
 	}
 
-	bool field_parser::rearrange(headers& dst)
+	bool field_parser::rearrange(request_headers& dst, std::pmr::memory_resource& arena)
 	{
 		dst.clear();
-
+		if (m_field_list.empty())
+			return true;
+
+		// from the first name to the end of the last value
+		auto from = std::get<0>(m_field_list.front()).offset();
+		auto& last = std::get<1>(m_field_list.back());
+		auto length = last.offset() + last.length() - from;
+		auto copy = static_cast<char*>(arena.allocate(length, 1));
+		std::memcpy(copy, m_data + from, length);
+		auto base = copy - from;
+
+		dst.reserve(m_field_list.size());
 		for (auto& pair : m_field_list) {
-			auto key = header_key::make(produce(get(std::get<0>(pair))));
-			auto value = produce(get(std::get<1>(pair)));
-			dst.add(key, std::move(value));
-		}
+			auto& name = std::get<0>(pair);
+			auto& value = std::get<1>(pair);
+			std::string_view raw { base + value.offset(), value.length() };
 
-		m_field_list.clear();
-		m_field_list.shrink_to_fit();
-		m_contents.clear();
-		m_contents.shrink_to_fit();
-		m_last_line_end = 0;
+			dst.add(header_key::classify(view(name)), { base + name.offset(), name.length() }, trimmed(raw, arena));
+		}
 		return true;
 	}
 
-	auto find(std::vector<char>& line, char c)
+	std::optional<std::string> field_parser::find_front(const header_key& key) const
 	{
-		return std::find(begin(line), end(line), c);
+		for (auto& pair : m_field_list) {
+			if (key.matches(view(std::get<0>(pair))))
+				return produce(view(std::get<1>(pair)));
+		}
+		return std::nullopt;
 	}
 
-	auto rfind(std::vector<char>& line, char c)
+	size_t chunked_decoder::decode(const char* data, size_t size, std::string_view& body, size_t limit)
 	{
-		auto it__ = std::find(line.rbegin(), line.rend(), c);
-		if (it__ == line.rend())
-			return line.end();
-		else
-			return --it__.base();
+		body = { };
+		auto cur = data;
+		auto end = data + size;
+		auto taken = [&] { return static_cast<size_t>(cur - data); };
+		auto fail = [&] {
+			m_state = state::error;
+			return taken();
+		};
+
+		while (cur != end) {
+			auto c = *cur;
+			switch (m_state) {
+			case state::size: {
+				auto digit = c >= '0' && c <= '9' ? c - '0'
+					: c >= 'a' && c <= 'f' ? c - 'a' + 10
+					: c >= 'A' && c <= 'F' ? c - 'A' + 10
+					: -1;
+				if (digit >= 0) {
+					if (++m_digits > 15) // past anything sane
+						return fail();
+					m_left = m_left * 16 + static_cast<uint64_t>(digit);
+				} else if (!m_digits)
+					return fail();
+				else if (c == '\r')
+					m_state = state::size_lf;
+				else if (c == ';' || c == ' ' || c == '\t') {
+					m_state = state::extension;
+					m_line = 0;
+				} else
+					return fail();
+				break;
+			}
+			case state::extension:
+				if (c == '\r')
+					m_state = state::size_lf;
+				else if (++m_line > max_extension)
+					return fail();
+				break;
+			case state::size_lf:
+				if (c != '\n')
+					return fail();
+				m_digits = 0;
+				m_line = 0;
+				m_state = m_left ? state::data : state::trailer_start;
+				break;
+			case state::data: {
+				auto chunk = std::min({ m_left, static_cast<uint64_t>(end - cur), static_cast<uint64_t>(limit) });
+				if (!chunk)
+					return taken();
+				body = { cur, static_cast<size_t>(chunk) };
+				cur += chunk;
+				m_left -= chunk;
+				if (!m_left)
+					m_state = state::data_cr;
+				return taken();
+			}
+			case state::data_cr:
+				if (c != '\r')
+					return fail();
+				m_state = state::data_lf;
+				break;
+			case state::data_lf:
+				if (c != '\n')
+					return fail();
+				m_state = state::size;
+				break;
+			case state::trailer_start:
+				m_state = c == '\r' ? state::last_lf : state::trailer;
+				break;
+			case state::trailer:
+				if (c == '\r')
+					m_state = state::trailer_lf;
+				else if (++m_line > max_trailer)
+					return fail();
+				break;
+			case state::trailer_lf:
+				if (c != '\n')
+					return fail();
+				m_state = state::trailer_start;
+				break;
+			case state::last_lf:
+				if (c != '\n')
+					return fail();
+				m_state = state::done;
+				return taken() + 1;
+			case state::done:
+			case state::error:
+				return taken();
+			}
+			++cur;
+		}
+		return size;
 	}
 
-	parsing request_parser::first_line(data_src& src)
+	parsing request_parser::first_line(const char* data, size_t size, size_t& offset)
 	{
 		// Method SP Request-URI SP HTTP-Verson CRLF
-		std::vector<char> line;
-		auto ret = field_parser::read_line(src, line);
-		if (ret != parsing::separator)
-			return ret;
-
-		auto cur = line.data();
-		auto end = line.data() + line.size();
-		size_t len = 1;
-
-		line.pop_back(); // LF
-		line.pop_back(); // CR
+		auto end = scan::find(data, data + size, '\r');
+		if (end == data + size || end + 1 == data + size)
+			return parsing::incomplete;
+		if (end[1] != '\n')
+			return parsing::error;
 
-		auto proto_it = rfind(line, ' ');
-		if (proto_it == line.end())
+		auto length = static_cast<size_t>(end - data);
+		auto method_it = static_cast<const char*>(std::memchr(data, ' ', length));
+		auto proto_it = end;
+		while (proto_it != data && proto_it[-1] != ' ')
+			--proto_it;
+		if (!method_it || proto_it == data)
 			return parsing::error;
-		auto method_it = find(line, ' ');
+		--proto_it;
 		if (proto_it == method_it)
 			return parsing::error;
 
-		if (!parse_proto(std::next(proto_it), line.end(), m_proto))
+		if (!parse_proto(std::next(proto_it), end, m_proto))
 			return parsing::error;
 
-		m_method.assign(line.begin(), method_it);
+		m_method = field_parser::span(0, static_cast<size_t>(method_it - data));
 
 		while (method_it != proto_it && *method_it == ' ')
 			++method_it;
@@ -287,40 +417,86 @@ namespace web {
 		if (method_it == proto_it)
 			return parsing::error;
 
-		m_resource.assign(method_it, proto_it);
+		m_resource = field_parser::span(static_cast<size_t>(method_it - data), static_cast<size_t>(proto_it - method_it));
+		offset = length + 2;
 		return parsing::separator;
 	}
 
+	std::string_view base_authority::get(bool secure, std::string_view host, unsigned short port)
+	{
+		if (m_known && m_secure == secure && m_port == port && m_host == host)
+			return m_base;
+
+		std::string uri { secure ? "https://" : "http://" };
+		uri.append(host);
+		auto base = web::uri { std::move(uri) };
+		auto auth = web::uri::auth_builder::parse(base.authority());
+		auth.port = std::to_string(port);
+		base.authority(auth.string(web::uri::with_pass));
+		base = web::uri::normal(std::move(base), web::uri::with_pass);
+
+		m_base.clear();
+		if (base.has_authority()) {
+			auto authority = base.authority();
+			m_base.append(base.scheme());
+			m_base.append("://");
+			m_base.append(authority);
+		}
+		m_host.assign(host);
+		m_port = port;
+		m_secure = secure;
+		m_known = true;
+		return m_base;
+	}
+
 	bool request_parser::extract(bool secure, request& req, short unsigned port, const std::string& host_1_0)
 	{
-		auto m = make_method(m_method);
+		auto smethod = m_fields.get(m_method);
+		auto m = make_method(smethod);
 		if (m == method::other)
-			req.m_smethod = std::move(m_method);
-		else
-			m_method.clear(), req.m_method = m;
+			req.m_smethod = std::move(smethod);
+		// set before anything may fail, the answer to a bad request
+		// still looks at them
+		req.m_method = m;
+		req.m_version = m_proto;
 
-		if (!m_fields.rearrange(req.m_headers))
+		if (!m_fields.rearrange(req.m_headers, *req.m_arena))
 			return false;
 
-		std::string uri { "http" };
-		if (secure)
-			uri.push_back('s');
-		uri.append("://");
+		std::string_view host;
 		if (m_proto.M_ver() < 1 || (m_proto.M_ver() == 1 && m_proto.m_ver() == 0)) {
-			uri.append(host_1_0);
+			host = host_1_0;
 		} else if (m_proto == http_version::http_1_1) {
-			auto host = req.host();
-			if (!host)
+			auto value = req.host();
+			if (!value)
 				return false;
-			uri.append(*host);
+			host = *value;
 		}
-		auto host = web::uri { uri };
-		auto auth = web::uri::auth_builder::parse(host.authority());
-		auth.port = std::to_string(port);
-		host.authority(auth.string(web::uri::with_pass));
 
-		req.m_uri = web::uri::canonical(m_resource, host, web::uri::with_pass);
-		req.m_version = m_proto;
+		// most of the targets are normal paths already, which only need
+		// the scheme and the authority in front of them
+		auto target = m_fields.view(m_resource);
+		base_authority local;
+		auto base = (m_base ? *m_base : local).get(secure, host, port);
+		if (!base.empty() && web::uri::is_normal_origin(target)) {
+			std::string uri;
+			uri.reserve(base.length() + target.length());
+			uri.append(base);
+			uri.append(target);
+			req.m_uri = web::uri { std::move(uri) };
+		} else {
+			std::string uri { "http" };
+			if (secure)
+				uri.push_back('s');
+			uri.append("://");
+			uri.append(host);
+			auto host_uri = web::uri { uri };
+			auto auth = web::uri::auth_builder::parse(host_uri.authority());
+			auth.port = std::to_string(port);
+			host_uri.authority(auth.string(web::uri::with_pass));
+
+			req.m_uri = web::uri::canonical(std::string { target }, host_uri, web::uri::with_pass);
+		}
 		return true;
 	}
 }
@@ -9,8 +9,13 @@
 #include <web/server.h>
 #include <web/uri.h>
 #include <sys/stat.h>
+#include <cstdio>
 #include <ctime>
 
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
 namespace web {
 	const char* status_name(status st)
 	{
@@ -23,7 +28,14 @@ namespace web {
 		return nullptr;
 	}
 
-	void response::send_headers()
+	response::response(web::stream* os, request* req_ref)
+		: m_headers(req_ref ? req_ref->arena() : std::pmr::get_default_resource())
+		, m_os(os)
+		, m_req_ref(req_ref)
+	{
+	}
+
+	std::string response::serialize_headers()
 	{
 		if (!has(header::Content_Type))
 			set(header::Content_Type, "text/html; charset=UTF-8");
@@ -40,25 +52,39 @@ namespace web {
 		auto status_s = status_name(status());
 		if (!status_s)
 			status_s = "Unknown";
-		sprintf(status_line, "HTTP/%u.%u %u %s\r\n",
+		auto status_length = snprintf(status_line, sizeof(status_line), "HTTP/%u.%u %u %s\r\n",
 			version().M_ver(), version().m_ver(),
 			(unsigned)status(), status_s);
-		ll_print(status_line);
 
-		for (auto& header : m_headers) {
-			auto name = header.first.name();
+		size_t length = static_cast<size_t>(status_length) + 2;
+		for (auto& field : m_headers) {
+			auto name = field.key.name();
 			if (!name)
 				continue;
+			length += std::strlen(name) + field.value.length() + 4;
+		}
 
-			for (auto& val : header.second) {
-				std::string header = name;
-				header.append(": ");
-				header.append(val);
-				header.append("\r\n");
-				ll_print(header);
-			}
+		std::string out;
+		out.reserve(length);
+		out.append(status_line, static_cast<size_t>(status_length));
+
+		for (auto& field : m_headers) {
+			auto name = field.key.name();
+			if (!name)
+				continue;
+
+			out.append(name);
+			out.append(": ");
+			out.append(field.value);
+			out.append("\r\n");
 		}
-		ll_print("\r\n");
+		out.append("\r\n");
+		return out;
+	}
+
+	void response::send_headers()
+	{
+		ll_print(serialize_headers());
 	}
 
 	void response::set(const header_key& key, time_t value)
@@ -116,6 +142,16 @@ namespace web {
 		if (only_head)
 			return;
 
+		if (m_os->can_send_file()) {
+			auto fd = fileno(f.get());
+#ifdef __linux__
+			posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+#endif
+			if (!m_os->send_file(fd, 0, static_cast<uint64_t>(st.st_size)))
+				throw write_exception();
+			return;
+		}
+
 		char buffer[8192];
 
 		auto read = std::fread(buffer, 1, sizeof(buffer), f.get());
@@ -195,7 +231,7 @@ namespace web {
 			print("<p>See <a href='");
 			print(*loc);
 			print("'>");
-			print(uri::normal(*loc, uri::ui_safe).string());
+			print(uri::normal(uri { std::string_view { *loc } }, uri::ui_safe).string());
 			print("</a></p>");
 		}
 
@@ -225,15 +261,20 @@ namespace web {
 
 			if (!has(header::Content_Length))
 				set(header::Content_Length, std::to_string(m_contents.size()));
-			send_headers();
 
-			if (!only_head)
-				ll_write(m_contents.data(), m_contents.size());
+			// one write for the whole response, the body is not copied into the stream
+			auto head = serialize_headers();
+			buffer_view buffers[] = {
+				{ head.data(), head.length() },
+				{ m_contents.data(), only_head ? 0 : m_contents.size() }
+			};
+			if (!m_os->writev(buffers, only_head || m_contents.empty() ? 1 : 2))
+				throw write_exception();
 
 			m_contents.clear();
 		}
 
-		if (!m_os->overflow())
+		if (!m_os->flush())
 			throw write_exception();
 	}
 
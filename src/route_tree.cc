@@ -0,0 +1,259 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#include <web/route_tree.h>
+#include <web/route.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace web {
+	namespace {
+		constexpr size_t none = SIZE_MAX;
+
+		// the pattern parse_matcher() gives to a parameter without one
+		const std::string plain_pattern = "[^\\/]+?";
+
+		// KEY_PARTIAL changes only the optional keys
+		bool is_plain(const key_type& key)
+		{
+			return !(key.flags & (KEY_IS_STRING | KEY_ASTERISK | KEY_OPTIONAL | KEY_REPEAT)) &&
+				key.prefix == "/" && key.pattern == plain_pattern;
+		}
+	}
+
+	struct route_tree::node {
+		struct leaf {
+			size_t index;
+			std::shared_ptr<route> target;
+			bool strict;
+		};
+
+		std::string label;
+		std::vector<std::unique_ptr<node>> children; // the first bytes of the labels differ
+		std::unique_ptr<node> segment; // a parameter, up to the next slash
+		std::unique_ptr<node> rest; // the asterisk, up to the end
+		std::vector<leaf> ends; // the routes, which end here
+		std::vector<leaf> regexes; // the routes matched by their regexes from here
+		size_t first = none; // the lowest index of the routes below
+
+		void touch(size_t index)
+		{
+			if (first > index)
+				first = index;
+		}
+
+		node* literal(std::string_view text, size_t index);
+	};
+
+	route_tree::node* route_tree::node::literal(std::string_view text, size_t index)
+	{
+		auto cur = this;
+		cur->touch(index);
+		while (!text.empty()) {
+			auto it = std::find_if(cur->children.begin(), cur->children.end(), [&](const auto& child) {
+				return child->label.front() == text.front();
+			});
+			if (it == cur->children.end()) {
+				auto child = std::make_unique<node>();
+				child->label.assign(text);
+				child->touch(index);
+				cur->children.push_back(std::move(child));
+				return cur->children.back().get();
+			}
+
+			auto& label = (*it)->label;
+			size_t common = 1;
+			while (common < label.length() && common < text.length() && label[common] == text[common])
+				++common;
+
+			if (common < label.length()) {
+				// the child keeps the rest of its label, under the common part
+				auto middle = std::make_unique<node>();
+				middle->label.assign(label, 0, common);
+				middle->first = (*it)->first;
+				label.erase(0, common);
+				middle->children.push_back(std::move(*it));
+				*it = std::move(middle);
+			}
+
+			text.remove_prefix(common);
+			cur = it->get();
+			cur->touch(index);
+		}
+		return cur;
+	}
+
+	struct route_tree::search {
+		std::string_view path;
+		std::pmr::vector<param>& params;
+		std::pmr::vector<std::string_view> captures;
+		size_t best = none;
+		std::shared_ptr<route> found;
+
+		void take(const node::leaf& leaf)
+		{
+			auto& keys = leaf.target->matcher().keys;
+			assert(keys.size() == captures.size());
+
+			best = leaf.index;
+			found = leaf.target;
+			params.clear();
+			params.reserve(keys.size());
+			for (size_t i = 0; i < keys.size(); ++i)
+				params.push_back({ keys[i].svalue, keys[i].nvalue, captures[i] });
+		}
+
+		// rest is the part of the path after the label of the node
+		void visit(const node& cur, std::string_view rest)
+		{
+			// nothing here would win over the match found already
+			if (cur.first >= best)
+				return;
+
+			for (auto& leaf : cur.ends) {
+				if (leaf.index >= best)
+					break;
+				// non-strict masks take a single slash at the end
+				if (rest.empty() || (!leaf.strict && rest == "/")) {
+					take(leaf);
+					break;
+				}
+			}
+
+			for (auto& leaf : cur.regexes) {
+				if (leaf.index >= best)
+					break;
+				if (leaf.target->matcher().matches(path, params)) {
+					best = leaf.index;
+					found = leaf.target;
+					break;
+				}
+			}
+
+			if (!rest.empty()) {
+				for (auto& child : cur.children) {
+					if (child->label.front() != rest.front())
+						continue;
+					if (rest.compare(0, child->label.length(), child->label) == 0)
+						visit(*child, rest.substr(child->label.length()));
+					break;
+				}
+
+				if (cur.segment && rest.front() != '/') {
+					auto length = std::min(rest.find('/'), rest.length());
+					captures.push_back(rest.substr(0, length));
+					visit(*cur.segment, rest.substr(length));
+					captures.pop_back();
+				}
+			}
+
+			if (cur.rest) {
+				captures.push_back(rest);
+				visit(*cur.rest, { });
+				captures.pop_back();
+			}
+		}
+	};
+
+	route_tree::route_tree() : m_root { std::make_unique<node>() } { }
+	route_tree::route_tree(route_tree&&) = default;
+	route_tree& route_tree::operator=(route_tree&&) = default;
+	route_tree::~route_tree() = default;
+
+	void route_tree::add(const std::shared_ptr<route>& route)
+	{
+		auto const index = m_count++;
+		auto const options = route->options();
+		auto const tokens = parse_matcher(route->mask());
+
+		auto const sensitive = (options & COMPILE_SENSITIVE) == COMPILE_SENSITIVE;
+		auto const end = (options & COMPILE_END) == COMPILE_END;
+		auto const strict = (options & COMPILE_STRICT) == COMPILE_STRICT;
+		auto const take_rest = (options & COMPILE_TAKE_REST) == COMPILE_TAKE_REST;
+		if (!sensitive || !end)
+			return add_regex(route, index, tokens);
+
+		// as in description::make()
+		auto const ends_with_slash =
+			!tokens.empty() &&
+			(tokens.back().flags & KEY_IS_STRING) &&
+			!tokens.back().svalue.empty() &&
+			tokens.back().svalue.back() == '/';
+		auto const rest = take_rest && !ends_with_slash && !tokens.empty() && !(tokens.back().flags & KEY_IS_STRING)
+			? &tokens.back() : nullptr;
+
+		for (size_t i = 0; i < tokens.size(); ++i) {
+			auto& token = tokens[i];
+			if ((token.flags & KEY_IS_STRING) || &token == rest)
+				continue;
+
+			auto last = i + 1 == tokens.size();
+			if (token.flags == KEY_ASTERISK && last)
+				continue;
+
+			// the lazy parameter takes the whole segment, only if a slash
+			// or the end of the path comes next
+			if (!is_plain(token))
+				return add_regex(route, index, tokens);
+			if (!last) {
+				auto& next = tokens[i + 1];
+				auto slash = (next.flags & KEY_IS_STRING) ? next.svalue.front() == '/' : next.prefix == "/";
+				if (!slash)
+					return add_regex(route, index, tokens);
+			}
+		}
+
+		auto cur = m_root.get();
+		std::string text;
+		for (auto& token : tokens) {
+			if (token.flags & KEY_IS_STRING) {
+				text += token.svalue;
+				continue;
+			}
+
+			text += token.prefix;
+			cur = cur->literal(text, index);
+			text.clear();
+
+			auto& next = (&token == rest || (token.flags & KEY_ASTERISK)) ? cur->rest : cur->segment;
+			if (!next)
+				next = std::make_unique<node>();
+			cur = next.get();
+			cur->touch(index);
+		}
+
+		if (!strict && ends_with_slash)
+			text.pop_back();
+		cur = cur->literal(text, index);
+		cur->ends.push_back({ index, route, strict });
+	}
+
+	void route_tree::add_regex(const std::shared_ptr<route>& route, size_t index, const std::vector<key_type>& tokens)
+	{
+		// the regex starts with the leading strings, but for a slash at
+		// the end of the mask, which may be gone
+		std::string prefix;
+		if (route->options() & COMPILE_SENSITIVE) {
+			for (auto& token : tokens) {
+				if (!(token.flags & KEY_IS_STRING))
+					break;
+				prefix += token.svalue;
+			}
+			if (!prefix.empty() && prefix.back() == '/')
+				prefix.pop_back();
+		}
+
+		m_root->literal(prefix, index)->regexes.push_back({ index, route, false });
+		++m_regex_count;
+	}
+
+	std::shared_ptr<route> route_tree::find(std::string_view path, std::pmr::vector<param>& params) const
+	{
+		search state { path, params, std::pmr::vector<std::string_view> { params.get_allocator() }, none, nullptr };
+		state.visit(*m_root, path);
+		return state.found;
+	}
+}
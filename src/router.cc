@@ -9,18 +9,28 @@
 namespace web {
 	void router::add(const std::string& path, const endpoint_type& et, method m, int options)
 	{
-		assert(m != method::other);
-		m_handlers[m].push_back({ path, et, options });
+		add(path, et, m, content_policy { }, options);
 	}
 
 	void router::add(const std::string& path, const endpoint_type& et, const std::string& other_method, int options)
+	{
+		add(path, et, other_method, content_policy { }, options);
+	}
+
+	void router::add(const std::string& path, const endpoint_type& et, method m, const content_policy& content, int options)
+	{
+		assert(m != method::other);
+		m_handlers[m].push_back({ path, et, options, content });
+	}
+
+	void router::add(const std::string& path, const endpoint_type& et, const std::string& other_method, const content_policy& content, int options)
 	{
 		auto textual = other_method;
 		auto m = make_method(textual);
 		if (m == method::other)
-			m_shandlers[textual].push_back({ path, et, options });
+			m_shandlers[textual].push_back({ path, et, options, content });
 		else
-			m_handlers[m].push_back({ path, et, options });
+			m_handlers[m].push_back({ path, et, options, content });
 	}
 
 	void router::append(const std::string& path, const std::shared_ptr<router>& sub)
@@ -35,7 +45,7 @@ namespace web {
 
 	std::shared_ptr<route> router::compile(handler& src)
 	{
-		return std::make_shared<route>(src.mask, std::move(src.endpoint), src.options);
+		return std::make_shared<route>(src.mask, std::move(src.endpoint), src.options, src.content);
 	}
 
 	router::compiled router::compile()
@@ -94,31 +104,36 @@ namespace web {
 		m_routers.clear();
 	}
 
-	std::shared_ptr<route> router::compiled::find(method m, const std::string& path, std::vector<param>& params)
+	router::compiled::compiled(route_list&& routes, sroute_list&& sroutes, filter_list&& middleware)
+		: m_routes(std::move(routes))
+		, m_sroutes(std::move(sroutes))
+		, m_middleware(std::move(middleware))
 	{
-		auto it = m_routes.find(m);
-		if (it == m_routes.end())
-			return { };
-
-		for (auto& route : it->second) {
-			if (route->matcher().matches(path, params))
-				return route;
+		for (auto& pair : m_routes) {
+			auto& tree = m_trees[pair.first];
+			for (auto& route : pair.second)
+				tree.add(route);
+		}
+		for (auto& pair : m_sroutes) {
+			auto& tree = m_strees[pair.first];
+			for (auto& route : pair.second)
+				tree.add(route);
 		}
-
-		return { };
 	}
 
-	std::shared_ptr<route> router::compiled::find(const std::string& other_method, const std::string& path, std::vector<param>& params)
+	std::shared_ptr<route> router::compiled::find(method m, std::string_view path, std::pmr::vector<param>& params)
 	{
-		auto it = m_sroutes.find(other_method);
-		if (it == m_sroutes.end())
+		auto it = m_trees.find(m);
+		if (it == m_trees.end())
 			return { };
+		return it->second.find(path, params);
+	}
 
-		for (auto& route : it->second) {
-			if (route->matcher().matches(path, params))
-				return route;
-		}
-
-		return { };
+	std::shared_ptr<route> router::compiled::find(const std::string& other_method, std::string_view path, std::pmr::vector<param>& params)
+	{
+		auto it = m_strees.find(other_method);
+		if (it == m_strees.end())
+			return { };
+		return it->second.find(path, params);
 	}
-}
\ No newline at end of file
+}
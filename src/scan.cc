@@ -0,0 +1,367 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#include <web/bits/scan.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define WEB_SCAN_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define WEB_TARGET(isa)
+#else
+#define WEB_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace web { namespace scan {
+	namespace {
+		constexpr std::array<bool, 256> make_tchars()
+		{
+			std::array<bool, 256> out { };
+			for (int c = '0'; c <= '9'; ++c)
+				out[static_cast<size_t>(c)] = true;
+			for (int c = 'A'; c <= 'Z'; ++c)
+				out[static_cast<size_t>(c)] = true;
+			for (int c = 'a'; c <= 'z'; ++c)
+				out[static_cast<size_t>(c)] = true;
+			for (auto c : "!#$%&'*+-.^_`|~")
+				out[static_cast<uint8_t>(c)] = true;
+			out[0] = false; // the terminator of the string above
+			return out;
+		}
+
+		constexpr auto tchars = make_tchars();
+
+		constexpr std::array<bool, 256> make_unreserved()
+		{
+			std::array<bool, 256> out { };
+			for (int c = '0'; c <= '9'; ++c)
+				out[static_cast<size_t>(c)] = true;
+			for (int c = 'A'; c <= 'Z'; ++c)
+				out[static_cast<size_t>(c)] = true;
+			for (int c = 'a'; c <= 'z'; ++c)
+				out[static_cast<size_t>(c)] = true;
+			for (auto c : "-._~")
+				out[static_cast<uint8_t>(c)] = true;
+			out[0] = false;
+			return out;
+		}
+
+		constexpr auto unreserved = make_unreserved();
+
+		const char* scalar_find(const char* cur, const char* end, char c)
+		{
+			// an empty range may come as two null pointers, which memchr() may not get
+			if (cur == end)
+				return end;
+			auto it = static_cast<const char*>(std::memchr(cur, c, static_cast<size_t>(end - cur)));
+			return it ? it : end;
+		}
+
+		const char* scalar_find_non_token(const char* cur, const char* end)
+		{
+			while (cur != end && tchars[static_cast<uint8_t>(*cur)])
+				++cur;
+			return cur;
+		}
+
+		const char* scalar_find_unsafe(const char* cur, const char* end)
+		{
+			while (cur != end && unreserved[static_cast<uint8_t>(*cur)])
+				++cur;
+			return cur;
+		}
+
+#ifdef WEB_SCAN_X86
+		// Shorter inputs, e.g. most of the field names and many values,
+		// go through the scalar loops: setting the vectors up, and for
+		// avx2 waking the wider units, costs more than it saves there.
+		constexpr ptrdiff_t sse2_min = 16;
+		constexpr ptrdiff_t avx2_min = 64;
+
+		inline unsigned first_bit(unsigned mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+#else
+			return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+		}
+
+		// Bytes from lo to hi, signed compares after moving lo to -128.
+		WEB_TARGET("sse2")
+		inline __m128i in_range(__m128i v, char lo, char hi)
+		{
+			auto shifted = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(-128 - lo)));
+			return _mm_cmplt_epi8(shifted, _mm_set1_epi8(static_cast<char>(-128 + (hi - lo) + 1)));
+		}
+
+		// Alphanumerics and dashes, which are most of the field names;
+		// other bytes are looked up one by one.
+		WEB_TARGET("sse2")
+		inline unsigned sse2_common_token(__m128i v)
+		{
+			auto digit = in_range(v, '0', '9');
+			auto alpha = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+			auto dash = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));
+			return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(digit, alpha), dash)));
+		}
+
+		WEB_TARGET("sse2")
+		const char* sse2_find(const char* cur, const char* end, char c)
+		{
+			if (end - cur < sse2_min)
+				return scalar_find(cur, end, c);
+			auto needle = _mm_set1_epi8(c);
+			while (end - cur >= 16) {
+				auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur));
+				auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+				if (mask)
+					return cur + first_bit(mask);
+				cur += 16;
+			}
+			while (cur != end && *cur != c)
+				++cur;
+			return cur;
+		}
+
+		WEB_TARGET("sse2")
+		const char* sse2_find_non_token(const char* cur, const char* end)
+		{
+			if (end - cur < sse2_min)
+				return scalar_find_non_token(cur, end);
+			while (end - cur >= 16) {
+				auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur));
+				auto mask = ~sse2_common_token(v) & 0xFFFFu;
+				if (!mask) {
+					cur += 16;
+					continue;
+				}
+				cur += first_bit(mask);
+				if (!tchars[static_cast<uint8_t>(*cur)])
+					return cur;
+				++cur;
+			}
+			return scalar_find_non_token(cur, end);
+		}
+
+		// all of the unreserved bytes, so there is no second look
+		WEB_TARGET("sse2")
+		inline unsigned sse2_unreserved(__m128i v)
+		{
+			auto digit = in_range(v, '0', '9');
+			auto alpha = in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+			auto dash = _mm_cmpeq_epi8(v, _mm_set1_epi8('-'));
+			auto dot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+			auto under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+			auto tilde = _mm_cmpeq_epi8(v, _mm_set1_epi8('~'));
+			auto marks = _mm_or_si128(_mm_or_si128(dash, dot), _mm_or_si128(under, tilde));
+			return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(digit, alpha), marks)));
+		}
+
+		WEB_TARGET("sse2")
+		const char* sse2_find_unsafe(const char* cur, const char* end)
+		{
+			if (end - cur < sse2_min)
+				return scalar_find_unsafe(cur, end);
+			while (end - cur >= 16) {
+				auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cur));
+				auto mask = ~sse2_unreserved(v) & 0xFFFFu;
+				if (mask)
+					return cur + first_bit(mask);
+				cur += 16;
+			}
+			return scalar_find_unsafe(cur, end);
+		}
+
+		WEB_TARGET("avx2")
+		inline __m256i in_range(__m256i v, char lo, char hi)
+		{
+			auto shifted = _mm256_add_epi8(v, _mm256_set1_epi8(static_cast<char>(-128 - lo)));
+			return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + (hi - lo) + 1)), shifted);
+		}
+
+		WEB_TARGET("avx2")
+		const char* avx2_find(const char* cur, const char* end, char c)
+		{
+			if (end - cur < avx2_min)
+				return scalar_find(cur, end, c);
+			auto needle = _mm256_set1_epi8(c);
+			while (end - cur >= 32) {
+				auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur));
+				auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+				if (mask)
+					return cur + first_bit(mask);
+				cur += 32;
+			}
+			return sse2_find(cur, end, c);
+		}
+
+		WEB_TARGET("avx2")
+		const char* avx2_find_non_token(const char* cur, const char* end)
+		{
+			if (end - cur < avx2_min)
+				return scalar_find_non_token(cur, end);
+			while (end - cur >= 32) {
+				auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur));
+				auto digit = in_range(v, '0', '9');
+				auto alpha = in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+				auto dash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'));
+				auto mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(digit, alpha), dash)));
+				if (!mask) {
+					cur += 32;
+					continue;
+				}
+				cur += first_bit(mask);
+				if (!tchars[static_cast<uint8_t>(*cur)])
+					return cur;
+				++cur;
+			}
+			return sse2_find_non_token(cur, end);
+		}
+
+		WEB_TARGET("avx2")
+		const char* avx2_find_unsafe(const char* cur, const char* end)
+		{
+			if (end - cur < avx2_min)
+				return scalar_find_unsafe(cur, end);
+			while (end - cur >= 32) {
+				auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cur));
+				auto digit = in_range(v, '0', '9');
+				auto alpha = in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+				auto dash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-'));
+				auto dot = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.'));
+				auto under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+				auto tilde = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('~'));
+				auto marks = _mm256_or_si256(_mm256_or_si256(dash, dot), _mm256_or_si256(under, tilde));
+				auto mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(digit, alpha), marks)));
+				if (mask)
+					return cur + first_bit(mask);
+				cur += 32;
+			}
+			return sse2_find_unsafe(cur, end);
+		}
+
+		bool has_avx2()
+		{
+#ifdef _MSC_VER
+			int regs[4];
+			__cpuid(regs, 1);
+			bool osxsave = (regs[2] & (1 << 27)) != 0;
+			bool avx = (regs[2] & (1 << 28)) != 0;
+			if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+				return false;
+			__cpuidex(regs, 7, 0);
+			return (regs[1] & (1 << 5)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+
+		bool has_sse2()
+		{
+#if defined(__x86_64__) || defined(_M_X64)
+			return true;
+#elif defined(_MSC_VER)
+			int regs[4];
+			__cpuid(regs, 1);
+			return (regs[3] & (1 << 26)) != 0;
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse2");
+#endif
+		}
+#endif // WEB_SCAN_X86
+
+		const kernels& table(isa level)
+		{
+			static constexpr kernels scalar { scalar_find, scalar_find_non_token, scalar_find_unsafe };
+#ifdef WEB_SCAN_X86
+			static constexpr kernels sse2 { sse2_find, sse2_find_non_token, sse2_find_unsafe };
+			static constexpr kernels avx2 { avx2_find, avx2_find_non_token, avx2_find_unsafe };
+			switch (level) {
+			case isa::avx2: return avx2;
+			case isa::sse2: return sse2;
+			default: break;
+			}
+#else
+			(void)level;
+#endif
+			return scalar;
+		}
+
+		std::atomic<const kernels*> selected { nullptr };
+	}
+
+	isa supported()
+	{
+		static const isa level = [] {
+#ifdef WEB_SCAN_X86
+			if (has_avx2())
+				return isa::avx2;
+			if (has_sse2())
+				return isa::sse2;
+#endif
+			return isa::scalar;
+		}();
+		return level;
+	}
+
+	isa current()
+	{
+		auto& ref = active();
+		for (auto level : { isa::avx2, isa::sse2 }) {
+			if (level <= supported() && &table(level) == &ref)
+				return level;
+		}
+		return isa::scalar;
+	}
+
+	void use(isa level)
+	{
+		if (level > supported())
+			return;
+		selected.store(&table(level), std::memory_order_relaxed);
+	}
+
+	const char* name(isa level)
+	{
+		switch (level) {
+		case isa::avx2: return "avx2";
+		case isa::sse2: return "sse2";
+		default: break;
+		}
+		return "scalar";
+	}
+
+	const kernels& active()
+	{
+		auto ptr = selected.load(std::memory_order_relaxed);
+		if (!ptr) {
+			ptr = &table(supported());
+			selected.store(ptr, std::memory_order_relaxed);
+		}
+		return *ptr;
+	}
+
+	bool is_token(char c)
+	{
+		return tchars[static_cast<uint8_t>(c)];
+	}
+
+	bool is_unreserved(char c)
+	{
+		return unreserved[static_cast<uint8_t>(c)];
+	}
+}} // web::scan
@@ -20,6 +20,16 @@ namespace web {
 	void server::set_routes(router& router)
 	{
 		m_routes = router.compile();
+
+		m_max_content = content_policy::buffered_max;
+		auto update = [&](auto const& list) {
+			for (auto& pair : list) {
+				for (auto& handler : pair.second)
+					m_max_content = std::max(m_max_content, handler->content().limit());
+			}
+		};
+		update(m_routes.routes());
+		update(m_routes.sroutes());
 	}
 
 	void server::print() const
@@ -106,7 +116,7 @@ namespace web {
 
 	struct diag {
 		http_version_t ver;
-		web::uri uri;
+		const web::uri& uri; // only the path and the query are logged
 		method mth;
 		std::string smth;
 		status st;
@@ -151,7 +161,8 @@ namespace web {
 				o << rr.req.smethod();
 			}
 
-			auto const uri = web::uri::normal(rr.req.uri(), web::uri::ui_safe);
+			// extract() has normalised the target already
+			auto const& uri = rr.req.uri();
 			auto const ver = rr.req.version();
 			return o
 				<< " \"" << uri.path() << uri.query()
@@ -160,136 +171,340 @@ namespace web {
 		}
 	};
 
-	struct stream_src : public data_src {
-		stream* p;
-		stream_src(stream* p) : p { p } { }
-		size_t get(char* data, size_t s) override
-		{
-			return p->read(data, s);
+	// Parses the head straight from the bytes buffered in the stream and
+	// consumes it. The parser keeps pointing into the buffer, which stays
+	// put until the next read, i.e. until the content is loaded.
+	static parsing read_head(stream& io, request_parser& parser)
+	{
+		while (true) {
+			auto [data, size] = io.peek();
+			auto ret = parser.parse(data, size);
+			if (ret == parsing::separator)
+				io.consume(parser.head_length());
+			if (ret != parsing::incomplete)
+				return ret;
+			if (!io.fill())
+				return parsing::error;
 		}
-	};
+	}
 
 	void server::on_connection(stream& io, bool secure)
 	{
-		stream_src src { &io };
+		// one arena for the connection, emptied after every request
+		request_arena arena;
+		base_authority base;
+
+		// responses wait for the next read, which is not needed as long
+		// as the client pipelines
+		io.cork();
+		auto const depth = m_svc.pipeline_depth();
+		size_t pipelined = 0;
+
+		using clock = std::chrono::steady_clock;
+		clock::time_point start, parsed;
 
 		unsigned conn_no{};
 		while (io.is_open()) {
 			io.conn_no(++conn_no);
-
-			request_parser parser;
-			auto ret = parser.decode(src);
+			io.stage(io_stage::idle);
+
+			if (m_stage_timer)
+				start = clock::now();
+			arena.release();
+			request_parser parser { arena.get(), m_limits, &base };
+			auto ret = read_head(io, parser);
+			if (ret == parsing::line_too_long || ret == parsing::head_too_large) {
+				on_rejected(io, parser, ret);
+				break;
+			}
 			if (ret != parsing::separator) {
 				io.shutdown();
 				LOG_DBG2() << "[CONN " << conn_no << "] ERROR";
 				break;
 			}
 
-			request req{ this };
-			response resp { &io, &req };
-			auto local = io.local_endpoint();
-			auto remote = io.remote_endpoint();
-			reporter rep(remote.host + ":" + std::to_string(remote.port), req, resp);
-			if (!parser.extract(secure, req, local.port, local.host)) {
-				LOG_DBG2() << "[CONN " << conn_no << "] REQ " << remote.host << ":" << remote.port << " ERROR";
-				try {
-					resp.version(http_version::http_1_1);
-					resp.stock_response(status::bad_request);
-				} catch (response::write_exception&) {
-					// ignore, we are breaking anyway
-				}
-				io.shutdown();
+			if (!io.held())
+				pipelined = 0;
+
+			if (m_stage_timer)
+				parsed = clock::now();
+			auto keep_alive = on_request(io, parser, secure);
+			if (m_stage_timer)
+				m_stage_timer(parsed - start, clock::now() - parsed);
+			if (!keep_alive)
 				break;
+
+			if (++pipelined >= depth) {
+				pipelined = 0;
+				if (!io.send_held())
+					break;
 			}
+			LOG_DBG2() << "NEXT ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
+		}
+		io.uncork();
+	}
 
-			{
-				diag dg{ req.version(), web::uri::normal(req.uri(), web::uri::ui_safe).string(), req.method() };
-				if (dg.mth == method::other)
-					dg.smth = req.smethod();
-				dg.st = resp.status();
-
-				const char* method = nullptr;
-				switch (dg.mth) {
-				case web::method::connect: method = "CONNECT"; break;
-				case web::method::del: method = "DELETE"; break;
-				case web::method::get: method = "GET"; break;
-				case web::method::head: method = "HEAD"; break;
-				case web::method::options: method = "OPTIONS"; break;
-				case web::method::post: method = "POST"; break;
-				case web::method::put: method = "PUT"; break;
-				case web::method::trace: method = "TRACE"; break;
-				default:
-					method = dg.smth.c_str();
-				}
+	bool server::on_request(stream& io, request_parser& parser, bool secure)
+	{
+		auto const conn_no = io.conn_no();
+		request req{ this, parser.arena() };
+		response resp { &io, &req };
+		auto local = io.local_endpoint();
+		auto remote = io.remote_endpoint();
+		reporter rep(remote.host + ":" + std::to_string(remote.port), req, resp);
+		if (!parser.extract(secure, req, local.port, local.host)) {
+			LOG_DBG2() << "[CONN " << conn_no << "] REQ " << remote.host << ":" << remote.port << " ERROR";
+			try {
+				resp.version(http_version::http_1_1);
+				resp.stock_response(status::bad_request);
+				resp.finish();
+			} catch (response::write_exception&) {
+				// ignore, we are breaking anyway
+			}
+			io.shutdown();
+			return false;
+		}
 
-				auto const path_view = dg.uri.path();
-				auto const query_view = dg.uri.query();
-
-				LOG_DBG2() << "[CONN " << conn_no << "] REQ  | " << remote.host << ":" << remote.port << " | "
-				          << method << " " << path_view << query_view
-				          << " HTTP/" << dg.ver.M_ver() << "." << dg.ver.m_ver();
-				for (auto const& [header, values] : req.headers()) {
-					auto name = header.name();
-					if (!name) name = "(null)";
-					for (auto const& value : values)
-						LOG_DBG2() << "[CONN " << conn_no << "]      | " << name << ": " << value;
-				}
+		{
+			diag dg{ req.version(), req.uri(), req.method() };
+			if (dg.mth == method::other)
+				dg.smth = req.smethod();
+			dg.st = resp.status();
+
+			const char* method = nullptr;
+			switch (dg.mth) {
+			case web::method::connect: method = "CONNECT"; break;
+			case web::method::del: method = "DELETE"; break;
+			case web::method::get: method = "GET"; break;
+			case web::method::head: method = "HEAD"; break;
+			case web::method::options: method = "OPTIONS"; break;
+			case web::method::post: method = "POST"; break;
+			case web::method::put: method = "PUT"; break;
+			case web::method::trace: method = "TRACE"; break;
+			default:
+				method = dg.smth.c_str();
+			}
 
-				auto fwdd = req.find_front(
-					web::header_key::make("x-forwarded-for")
-				);
+			auto const path_view = dg.uri.path();
+			auto const query_view = dg.uri.query();
 
-				if (fwdd) {
-					rep.forwarded_for(*fwdd);
-					req.remote(*fwdd);
-				} else {
-					req.remote(remote.host);
-				}
+			LOG_DBG2() << "[CONN " << conn_no << "] REQ  | " << remote.host << ":" << remote.port << " | "
+			          << method << " " << path_view << query_view
+			          << " HTTP/" << dg.ver.M_ver() << "." << dg.ver.m_ver();
+			for (auto const& field : req.headers())
+				LOG_DBG2() << "[CONN " << conn_no << "]      | " << field.name << ": " << field.value;
+
+			auto fwdd = req.find_front(
+				web::header_key::make("x-forwarded-for")
+			);
 
+			if (fwdd) {
+				rep.forwarded_for(std::string { *fwdd });
+				req.remote(std::string { *fwdd });
+			} else {
+				req.remote(remote.host);
 			}
 
+		}
+
+		// the handler reads the content, if it wants to
+		content_reader content { io };
+		auto framing = content.open(req.headers(), req.version());
+		if (framing == content_reader::framing::bad_length || framing == content_reader::framing::bad_coding) {
+			LOG_DBG2() << "[CONN " << conn_no << "] REQ " << remote.host << ":" << remote.port << " BAD CONTENT";
 			try {
-				load_content(io, req);
 				resp.version(req.version());
-				handle_connection(req, resp);
+				resp.stock_response(framing == content_reader::framing::bad_coding ? status::not_implemented : status::bad_request);
 				resp.finish();
-				LOG_DBG2() << "[CONN " << conn_no << "] RESP | " << remote.host << ":" << remote.port
-				          << " | HTTP/" << resp.version().M_ver() << "." << resp.version().m_ver()
-				          << " " << (unsigned)resp.status() << " " << status_name(resp.status());
-				for (auto const&[header, values] : resp.headers()) {
-					auto name = header.name();
-					if (!name) name = "(null)";
-					for (auto const& value : values)
-						LOG_DBG2() << "[CONN " << conn_no << "]      | " << name << ": " << value;
-				}
 			} catch (response::write_exception&) {
-				io.shutdown();
-				break;
+				// ignore, we are breaking anyway
 			}
+			io.shutdown();
+			return false;
+		}
+		req.m_content = &content;
+		if (parser.continued())
+			content.continued();
+		// until a route says otherwise
+		content.limit(capped(content_policy::buffered_max));
+
+		try {
+			io.stage(io_stage::reply);
+			resp.version(req.version());
+			handle_connection(req, resp);
+			resp.finish();
+			LOG_DBG2() << "[CONN " << conn_no << "] RESP | " << remote.host << ":" << remote.port
+			          << " | HTTP/" << resp.version().M_ver() << "." << resp.version().m_ver()
+			          << " " << (unsigned)resp.status() << " " << status_name(resp.status());
+			for (auto const& field : resp.headers()) {
+				auto name = field.key.name();
+				if (!name) name = "(null)";
+				LOG_DBG2() << "[CONN " << conn_no << "]      | " << name << ": " << field.value;
+			}
+		} catch (response::write_exception&) {
+			io.shutdown();
+			return false;
+		}
 
-			if (!should_keep_alive(req)) {
-				LOG_DBG2() << conn_no << ". shutdown : don't keep alive";
-				io.shutdown();
-				break;
+		if (content.too_large())
+			++m_rejected.content;
+
+		// the next request starts after the content
+		if (!should_keep_alive(req) || !content.skip()) {
+			LOG_DBG2() << conn_no << ". shutdown : don't keep alive";
+			io.shutdown();
+			return false;
+		}
+		return true;
+	}
+
+	bool server::on_overload(stream& io, request_parser& parser, bool secure)
+	{
+		auto const conn_no = io.conn_no();
+		request req{ this, parser.arena() };
+		response resp { &io, &req };
+		auto local = io.local_endpoint();
+		if (!parser.extract(secure, req, local.port, local.host)) {
+			LOG_DBG2() << "[CONN " << conn_no << "] OVERLOAD ERROR";
+			io.shutdown();
+			return false;
+		}
+
+		LOG_DBG2() << "[CONN " << conn_no << "] OVERLOAD | 503";
+		try {
+			resp.version(req.version());
+			resp.set(header::Retry_After, "1");
+			resp.stock_response(status::service_unavailable);
+			resp.finish();
+		} catch (response::write_exception&) {
+			io.shutdown();
+			return false;
+		}
+
+		if (!should_keep_alive(req)) {
+			io.shutdown();
+			return false;
+		}
+		return true;
+	}
+
+	// The async connection asks, before the content arrives, if the
+	// client, which waits for 100 Continue, should send it. Returns
+	// false, if io got the final response instead.
+	bool server::on_expect(stream& io, request_parser& parser, bool secure)
+	{
+		request req{ this, parser.arena() };
+		response resp { &io, &req };
+		auto answer = [&](status st) {
+			try {
+				resp.version(http_version::http_1_1);
+				resp.stock_response(st);
+				resp.finish();
+			} catch (response::write_exception&) {
+				// ignore, we are breaking anyway
 			}
-			LOG_DBG2() << "NEXT ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~";
+			return false;
+		};
+
+		auto local = io.local_endpoint();
+		if (!parser.extract(secure, req, local.port, local.host))
+			return answer(status::bad_request);
+
+		content_reader content { io };
+		auto framing = content.open(req.headers(), req.version());
+		if (framing == content_reader::framing::bad_length || framing == content_reader::framing::bad_coding)
+			return answer(framing == content_reader::framing::bad_coding ? status::not_implemented : status::bad_request);
+		if (!content.expects_continue())
+			return true;
+		req.m_content = &content;
+		resp.version(req.version());
+
+		std::pmr::vector<web::param> params { req.arena() };
+		auto handler = find_route(req, params);
+		if (handler) {
+			std::swap(params, req.m_params);
+			if (!admit(*handler, req, resp)) {
+				if (content.too_large())
+					++m_rejected.content;
+				try {
+					resp.finish();
+				} catch (response::write_exception&) {
+					// ignore, we are breaking anyway
+				}
+				return false;
+			}
+			return content.send_continue();
+		}
+
+		// the filters decide only, when the request is served
+		auto const res_view = req.uri().path();
+		auto resource = std::string{ res_view.data(), res_view.length() };
+		for (auto& pair : m_routes.filters()) {
+			if (starts_with(resource, pair.first))
+				return content.send_continue();
 		}
+		return answer(status::not_found);
 	}
 
-	void server::load_content(stream& io, request& req)
+	void server::on_rejected(stream& io, request_parser& parser, parsing reason)
 	{
-		auto slen = req.find_front(header::Content_Length);
-		if (!slen)
-			return;
+		auto st = status::request_header_fields_too_large;
+		auto what = "HEAD";
+		auto counter = &m_rejected.head;
+		if (reason == parsing::line_too_long) {
+			st = status::uri_too_long;
+			what = "REQUEST LINE";
+			counter = &m_rejected.line;
+		} else if (reason == parsing::content_too_large) {
+			st = status::payload_too_large;
+			what = "CONTENT";
+			counter = &m_rejected.content;
+		}
+		++*counter;
+		LOG_DBG2() << "[CONN " << io.conn_no() << "] " << what << " TOO LARGE";
+
+		request req{ this, parser.arena() };
+		response resp { &io, &req };
+		try {
+			resp.version(http_version::http_1_1);
+			resp.stock_response(st);
+			resp.finish();
+		} catch (response::write_exception&) {
+			// ignore, we are breaking anyway
+		}
+		io.shutdown();
+	}
 
-		char* bad = nullptr;
-		auto length = static_cast<size_t>(std::strtoull(slen->c_str(), &bad, 10));
-		if (bad && *bad)
-			return;
+	limit_stats server::rejected() const
+	{
+		return { m_rejected.line.load(), m_rejected.head.load(), m_rejected.content.load() };
+	}
+
+	std::shared_ptr<route> server::find_route(request& req, std::pmr::vector<param>& params)
+	{
+		auto const res_view = req.uri().path();
+		return req.method() == method::other
+			? m_routes.find(req.smethod(), res_view, params)
+			: m_routes.find(req.method(), res_view, params);
+	}
 
-		req.m_payload.resize(length);
-		if (length)
-			io.read(&req.m_payload[0], length);
+	// Applies the limit of the route and lets its accept hook look at the
+	// request, before the content is read. Returns false, if the response
+	// is the final answer already.
+	bool server::admit(route& handler, request& req, response& resp)
+	{
+		auto& content = *req.m_content;
+		auto& policy = handler.content();
+		content.limit(capped(policy.limit()));
+		// nothing is read or allocated for it
+		if (!content.fits_limit()) {
+			resp.stock_response(status::payload_too_large);
+			return false;
+		}
+
+		if (content.admitted() || !policy.accept)
+			return true;
+		return policy.accept(req, resp);
 	}
 
 	void server::handle_connection(request& req, response& resp)
@@ -305,10 +520,8 @@ namespace web {
 			}
 		}
 
-		std::vector<web::param> params;
-		auto handler = req.method() == method::other
-			? m_routes.find(req.smethod(), resource, params)
-			: m_routes.find(req.method(), resource, params);
+		std::pmr::vector<web::param> params { req.arena() };
+		auto handler = find_route(req, params);
 
 		if (!handler) {
 			resp.stock_response(status::not_found);
@@ -331,6 +544,17 @@ namespace web {
 		}
 
 		std::swap(params, req.m_params);
+		if (req.m_content) {
+			auto& content = *req.m_content;
+			if (!admit(*handler, req, resp))
+				return;
+			// asks for the content, if the client waits for 100 Continue
+			if (handler->content().mode == content_policy::buffered && !content.read_all(req.m_payload)) {
+				resp.stock_response(content.too_large() ? status::payload_too_large : status::bad_request);
+				return;
+			}
+		}
+
 		handler->call(req, resp);
 	}
 
@@ -7,4 +7,90 @@
 
 namespace web {
 	stream::impl::~impl() = default;
+
+	bool stream::impl::writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn)
+	{
+		for (size_t i = 0; i < count; ++i) {
+			if (!buffers[i].size)
+				continue;
+			if (!overflow(src, buffers[i].data, buffers[i].size, conn))
+				return false;
+		}
+		return true;
+	}
+
+	bool stream::impl::can_send_file(stream*)
+	{
+		return false;
+	}
+
+	bool stream::impl::send_file(stream*, int, uint64_t, uint64_t, unsigned)
+	{
+		return false;
+	}
+
+	void stream::impl::stage(stream*, io_stage)
+	{
+	}
+
+	bool stream::writev(const buffer_view* buffers, size_t count)
+	{
+		auto staged = write_data();
+		if (m_corked) {
+			auto size = std::get<1>(staged);
+			for (size_t i = 0; i < count; ++i)
+				size += buffers[i].size;
+
+			if (m_held.size() + size < held_limit) {
+				auto append = [&](const void* data, size_t length) {
+					auto ptr = static_cast<const char*>(data);
+					m_held.insert(m_held.end(), ptr, ptr + length);
+				};
+				append(std::get<0>(staged), std::get<1>(staged));
+				for (size_t i = 0; i < count; ++i)
+					append(buffers[i].data, buffers[i].size);
+				flushed_write();
+				return true;
+			}
+		}
+
+		if (m_held.empty() && !std::get<1>(staged)) {
+			if (!m_impl.writev(this, buffers, count, conn_))
+				return false;
+			flushed_write();
+			return true;
+		}
+
+		std::vector<buffer_view> all;
+		all.reserve(count + 2);
+		if (!m_held.empty())
+			all.push_back({ m_held.data(), m_held.size() });
+		if (std::get<1>(staged))
+			all.push_back({ std::get<0>(staged), std::get<1>(staged) });
+		all.insert(all.end(), buffers, buffers + count);
+		auto result = m_impl.writev(this, all.data(), all.size(), conn_);
+		m_held.clear();
+		if (!result)
+			return false;
+		flushed_write();
+		return true;
+	}
+
+	bool stream::send_held()
+	{
+		if (m_held.empty())
+			return true;
+
+		auto staged = write_data();
+		buffer_view buffers[] = {
+			{ m_held.data(), m_held.size() },
+			{ std::get<0>(staged), std::get<1>(staged) }
+		};
+		auto result = m_impl.writev(this, buffers, std::get<1>(staged) ? 2 : 1, conn_);
+		m_held.clear();
+		if (!result)
+			return false;
+		flushed_write();
+		return true;
+	}
 }
@@ -0,0 +1,109 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#include <web/thread_pool.h>
+#include <web/log.h>
+
+namespace web {
+	thread_pool::thread_pool(size_t max_threads, size_t stack_size)
+		: m_max_threads { max_threads }
+		, m_stack_size { stack_size }
+	{
+	}
+
+	thread_pool::~thread_pool()
+	{
+		stop();
+	}
+
+	void thread_pool::post(job&& task)
+	{
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			m_jobs.push_back(std::move(task));
+			if (!m_idle && (!m_max_threads || m_threads.size() < m_max_threads)) {
+				if (spawn())
+					return;
+				// with at least one thread running, the job will get picked up eventually
+				if (m_threads.empty())
+					LOG_ERR() << "thread_pool::post(this:" << this << ") -- cannot start a thread";
+			}
+		}
+		m_cv.notify_one();
+	}
+
+	void thread_pool::stop()
+	{
+		std::vector<native_thread> threads;
+		{
+			std::lock_guard<std::mutex> lock { m_mtx };
+			m_stopped = true;
+			std::swap(threads, m_threads);
+		}
+		m_cv.notify_all();
+
+		for (auto& th : threads) {
+#if defined(__unix__) || defined(__APPLE__)
+			pthread_join(th, nullptr);
+#else
+			th.join();
+#endif
+		}
+	}
+
+	size_t thread_pool::threads() const
+	{
+		std::lock_guard<std::mutex> lock { m_mtx };
+		return m_threads.size();
+	}
+
+	// called with m_mtx held
+	bool thread_pool::spawn()
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		pthread_attr_t attr;
+		if (pthread_attr_init(&attr))
+			return false;
+		if (m_stack_size)
+			pthread_attr_setstacksize(&attr, m_stack_size);
+
+		pthread_t th;
+		auto result = pthread_create(&th, &attr, [](void* self) -> void* {
+			static_cast<thread_pool*>(self)->work();
+			return nullptr;
+		}, this);
+		pthread_attr_destroy(&attr);
+		if (result)
+			return false;
+
+		m_threads.push_back(th);
+#else
+		m_threads.emplace_back([this] { work(); });
+#endif
+		return true;
+	}
+
+	void thread_pool::work()
+	{
+		std::unique_lock<std::mutex> lock { m_mtx };
+		while (true) {
+			++m_idle;
+			m_cv.wait(lock, [this] { return m_stopped || !m_jobs.empty(); });
+			--m_idle;
+
+			// drain the queue even when stopping; the jobs own the connections
+			if (m_jobs.empty())
+				return;
+
+			auto task = std::move(m_jobs.front());
+			m_jobs.pop_front();
+
+			lock.unlock();
+			task();
+			task = nullptr;
+			lock.lock();
+		}
+	}
+}
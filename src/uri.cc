@@ -23,6 +23,8 @@
  */
 
 #include <web/uri.h>
+#include <web/bits/scan.h>
+#include <algorithm>
 #include <cctype>
 
 namespace web {
@@ -115,6 +117,8 @@ namespace web {
 			return issafe(c) || c == ':' || c == '[' || c == ']';
 		}
 
+		// Pred takes at least the unreserved characters, which are skipped
+		// in runs; the other ones are looked at one by one.
 		template <typename Pred>
 		inline std::string urlencode(const char* in, size_t in_len, Pred&& safe)
 		{
@@ -123,17 +127,27 @@ namespace web {
 			auto b = in;
 			auto e = b + in_len;
 
-			for (auto it = b; it != e; ++it) {
+			for (auto it = scan::find_unsafe(b, e); it != e; it = scan::find_unsafe(it + 1, e)) {
 				if (!safe(*it))
 					length += 2;
 			}
 
+			if (length == in_len)
+				return { in, in_len };
+
 			static constexpr char hexes[] = "0123456789ABCDEF";
 			std::string out;
 			out.reserve(length);
 
-			for (auto it = b; it != e; ++it) {
-				auto c = *it;
+			auto it = b;
+			while (true) {
+				auto run = scan::find_unsafe(it, e);
+				out.append(it, run);
+				if (run == e)
+					break;
+
+				auto c = *run;
+				it = run + 1;
 				if (safe(c)) {
 					out += c;
 					continue;
@@ -180,16 +194,23 @@ namespace web {
 		std::string out;
 		out.reserve(in_len);
 
-		for (size_t i = 0; i < in_len; ++i) {
+		auto it = in;
+		auto end = in + in_len;
+		while (true) {
+			auto percent = scan::find(it, end, '%');
+			out.append(it, percent);
+			if (percent == end)
+				break;
+
 			// go inside only, if there is enough space
-			if (in[i] == '%' && (i < in_len - 2) &&
-				isxdigit(in[i + 1]) && isxdigit(in[i + 2])) {
-				unsigned char c = (hex(in[i + 1]) << 4) | hex(in[i + 2]);
+			if (end - percent >= 3 && isxdigit((uint8_t)percent[1]) && isxdigit((uint8_t)percent[2])) {
+				unsigned char c = (hex(percent[1]) << 4) | hex(percent[2]);
 				out += c;
-				i += 2;
+				it = percent + 3;
 				continue;
 			}
-			out += in[i];
+			out += '%';
+			it = percent + 1;
 		}
 		return out;
 	}
@@ -363,7 +384,11 @@ namespace web {
 #undef LOOK_FOR2
 #undef IS
 
-	uri::uri() = default;
+	uri::uri()
+	{
+		ensure_fragment();
+	}
+
 	uri::uri(const uri&) = default;
 	uri& uri::operator=(const uri&) = default;
 
@@ -710,6 +735,49 @@ namespace web {
 		return temp.path(path), normal(std::move(temp), flag);
 	}
 
+	bool uri::is_normal_origin(std::string_view target)
+	{
+		auto c = target.data();
+		auto end = c + target.length();
+		if (c == end || *c != '/')
+			return false;
+
+		auto upper_hex = [](char ch) { return (ch >= '0' && ch <= '9') || (ch >= 'A' && ch <= 'F'); };
+
+		// c is at a slash, starting the next segment
+		while (c != end && *c == '/') {
+			auto segment = ++c;
+			while (c != end && *c != '/' && *c != '?') {
+				if (*c == '#')
+					return false;
+				if (*c == '%') {
+					// urlencode(urldecode()) would change anything else
+					if (end - c < 3 || !upper_hex(c[1]) || !upper_hex(c[2]) ||
+						issafe(static_cast<unsigned char>((hex(c[1]) << 4) | hex(c[2]))))
+						return false;
+					c += 3;
+					continue;
+				}
+				if (!issafe(static_cast<unsigned char>(*c)))
+					return false;
+				++c;
+			}
+
+			auto length = c - segment;
+			if (!length) {
+				// only the last one may be empty
+				if (c != end && *c == '/')
+					return false;
+				continue;
+			}
+			if (*segment == '.' && (length == 1 || (length == 2 && segment[1] == '.')))
+				return false;
+		}
+
+		// the query is taken as it is, up to the fragment
+		return std::find(c, end, '#') == end;
+	}
+
 	uri uri::normal(uri tmp, auth_flag flag)
 	{
 		if (tmp.m_scheme != npos) {
@@ -797,4 +865,83 @@ namespace web {
 
 		return tmp;
 	}
+
+	namespace {
+		inline const char* find_escape(const char* cur, const char* end)
+		{
+			return std::find_if(cur, end, [](char c) { return c == '%' || c == '+'; });
+		}
+	}
+
+	query_view::query_view(std::string_view query)
+		: m_query { query }
+	{
+		if (!m_query.empty() && m_query.front() == '?')
+			m_query.remove_prefix(1);
+	}
+
+	query_view::iterator::iterator(const char* cur, const char* end)
+		: m_next { cur }
+		, m_end { end }
+	{
+		next();
+	}
+
+	void query_view::iterator::next()
+	{
+		m_cur = m_next;
+		while (m_cur != m_end) {
+			auto amp = scan::find(m_cur, m_end, '&');
+			if (amp == m_cur) {
+				++m_cur;
+				continue;
+			}
+
+			auto eq = scan::find(m_cur, amp, '=');
+			m_field.name = { m_cur, static_cast<size_t>(eq - m_cur) };
+			m_field.value = eq == amp ? std::string_view { } : std::string_view { eq + 1, static_cast<size_t>(amp - eq - 1) };
+			m_next = amp == m_end ? amp : amp + 1;
+			return;
+		}
+		m_next = m_end;
+		m_field = { };
+	}
+
+	std::optional<std::string_view> query_view::find_front(std::string_view name) const
+	{
+		std::string buffer;
+		for (auto& fld : *this) {
+			if (fld.name == name || decode(fld.name, buffer) == name)
+				return fld.value;
+		}
+		return std::nullopt;
+	}
+
+	std::string_view query_view::decode(std::string_view raw, std::string& buffer)
+	{
+		auto it = raw.data();
+		auto end = it + raw.length();
+		auto escape = find_escape(it, end);
+		if (escape == end)
+			return raw;
+
+		buffer.clear();
+		buffer.reserve(raw.length());
+		while (escape != end) {
+			buffer.append(it, escape);
+			if (*escape == '+') {
+				buffer += ' ';
+				it = escape + 1;
+			} else if (end - escape >= 3 && isxdigit((uint8_t)escape[1]) && isxdigit((uint8_t)escape[2])) {
+				buffer += static_cast<char>((hex(escape[1]) << 4) | hex(escape[2]));
+				it = escape + 3;
+			} else {
+				buffer += '%';
+				it = escape + 1;
+			}
+			escape = find_escape(it, end);
+		}
+		buffer.append(it, end);
+		return buffer;
+	}
 }
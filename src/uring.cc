@@ -0,0 +1,763 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+
+#include <web/bits/uring.h>
+#include <system_error>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace web { namespace uring {
+	namespace {
+		constexpr unsigned ring_entries = 4096;
+		constexpr unsigned buffer_count = 1024; // a power of two
+		constexpr size_t buffer_size = 4096;
+
+		int sys_setup(unsigned entries, io_uring_params* params)
+		{
+			return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+		}
+
+		int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+		{
+			return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+		}
+
+		int sys_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+		{
+			return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+		}
+
+		[[noreturn]] void throw_errno(const char* what)
+		{
+			throw std::system_error(errno, std::system_category(), what);
+		}
+
+		template <typename T>
+		T* at(void* base, unsigned offset)
+		{
+			return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+		}
+
+		void* map_ring(int fd, size_t size, off_t offset)
+		{
+			auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+			return ptr == MAP_FAILED ? nullptr : ptr;
+		}
+
+		endpoint_t peer_of(int fd)
+		{
+			sockaddr_storage addr { };
+			socklen_t length = sizeof(addr);
+			if (getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &length))
+				return { };
+
+			char host[INET6_ADDRSTRLEN] = "";
+			if (addr.ss_family == AF_INET6) {
+				auto in6 = reinterpret_cast<sockaddr_in6*>(&addr);
+				inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+				return { host, ntohs(in6->sin6_port) };
+			}
+
+			auto in = reinterpret_cast<sockaddr_in*>(&addr);
+			inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+			return { host, ntohs(in->sin_port) };
+		}
+
+		unsigned short port_of(int fd)
+		{
+			sockaddr_storage addr { };
+			socklen_t length = sizeof(addr);
+			if (getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length))
+				return 0;
+			if (addr.ss_family == AF_INET6)
+				return ntohs(reinterpret_cast<sockaddr_in6*>(&addr)->sin6_port);
+			return ntohs(reinterpret_cast<sockaddr_in*>(&addr)->sin_port);
+		}
+	}
+
+	ring::ring(unsigned entries)
+	{
+		io_uring_params params { };
+		m_fd = sys_setup(entries, &params);
+		if (m_fd < 0)
+			throw_errno("io_uring_setup");
+
+		m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		auto const single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single_mmap)
+			m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+		m_sq_ring = map_ring(m_fd, m_sq_ring_size, IORING_OFF_SQ_RING);
+		m_cq_ring = single_mmap ? m_sq_ring : map_ring(m_fd, m_cq_ring_size, IORING_OFF_CQ_RING);
+		m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = static_cast<io_uring_sqe*>(map_ring(m_fd, m_sqes_size, IORING_OFF_SQES));
+		if (!m_sq_ring || !m_cq_ring || !m_sqes) {
+			auto error = errno;
+			release();
+			errno = error;
+			throw_errno("io_uring mmap");
+		}
+
+		m_sq_head = at<unsigned>(m_sq_ring, params.sq_off.head);
+		m_sq_tail = at<unsigned>(m_sq_ring, params.sq_off.tail);
+		m_sq_array = at<unsigned>(m_sq_ring, params.sq_off.array);
+		m_sq_mask = *at<unsigned>(m_sq_ring, params.sq_off.ring_mask);
+		m_sq_entries = *at<unsigned>(m_sq_ring, params.sq_off.ring_entries);
+		m_sq_local = *m_sq_tail;
+
+		m_cq_head = at<unsigned>(m_cq_ring, params.cq_off.head);
+		m_cq_tail = at<unsigned>(m_cq_ring, params.cq_off.tail);
+		m_cq_mask = *at<unsigned>(m_cq_ring, params.cq_off.ring_mask);
+		m_cqes = at<io_uring_cqe>(m_cq_ring, params.cq_off.cqes);
+
+		// one entry per slot, for good
+		for (unsigned i = 0; i < m_sq_entries; ++i)
+			m_sq_array[i] = i;
+	}
+
+	ring::~ring()
+	{
+		release();
+	}
+
+	void ring::release()
+	{
+		if (m_sqes)
+			munmap(m_sqes, m_sqes_size);
+		if (m_cq_ring && m_cq_ring != m_sq_ring)
+			munmap(m_cq_ring, m_cq_ring_size);
+		if (m_sq_ring)
+			munmap(m_sq_ring, m_sq_ring_size);
+		if (m_fd >= 0)
+			::close(m_fd);
+		m_sqes = nullptr;
+		m_cq_ring = m_sq_ring = nullptr;
+		m_fd = -1;
+	}
+
+	io_uring_sqe* ring::next_sqe()
+	{
+		if (m_sq_local - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+			submit(0);
+
+		auto sqe = &m_sqes[m_sq_local & m_sq_mask];
+		++m_sq_local;
+		std::memset(sqe, 0, sizeof(*sqe));
+		return sqe;
+	}
+
+	void ring::submit(unsigned wait_for)
+	{
+		__atomic_store_n(m_sq_tail, m_sq_local, __ATOMIC_RELEASE);
+		auto pending = m_sq_local - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+		if (!pending && !wait_for)
+			return;
+
+		if (sys_enter(m_fd, pending, wait_for, wait_for ? IORING_ENTER_GETEVENTS : 0u) < 0) {
+			// interrupted, or the completions must be drained first
+			if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+				throw_errno("io_uring_enter");
+		}
+	}
+
+	buffer_ring::buffer_ring(ring& owner, unsigned entries, size_t buffer_size)
+		: m_ring { owner }
+		, m_data { new char[entries * buffer_size] }
+		, m_buffer_size { buffer_size }
+		, m_entries { entries }
+	{
+		m_bufs_size = entries * sizeof(io_uring_buf);
+		auto mem = mmap(nullptr, m_bufs_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+			throw_errno("buffer ring mmap");
+		m_bufs = static_cast<io_uring_buf_ring*>(mem);
+
+		io_uring_buf_reg reg { };
+		reg.ring_addr = reinterpret_cast<uint64_t>(mem);
+		reg.ring_entries = entries;
+		reg.bgid = group;
+		if (sys_register(m_ring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+			auto error = errno;
+			munmap(mem, m_bufs_size);
+			errno = error;
+			throw_errno("IORING_REGISTER_PBUF_RING");
+		}
+
+		for (unsigned bid = 0; bid < entries; ++bid)
+			publish(static_cast<uint16_t>(bid));
+	}
+
+	buffer_ring::~buffer_ring()
+	{
+		io_uring_buf_reg reg { };
+		reg.bgid = group;
+		sys_register(m_ring.fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+		munmap(m_bufs, m_bufs_size);
+	}
+
+	void buffer_ring::recycle(uint16_t bid)
+	{
+		--m_in_use;
+		publish(bid);
+	}
+
+	void buffer_ring::publish(uint16_t bid)
+	{
+		// not m_bufs->bufs: in C++, the empty member of the flexible array
+		// wrapper takes space and moves the entries away from the tail
+		auto& buf = reinterpret_cast<io_uring_buf*>(m_bufs)[m_tail & (m_entries - 1)];
+		buf.addr = reinterpret_cast<uint64_t>(data(bid));
+		buf.len = static_cast<uint32_t>(m_buffer_size);
+		buf.bid = bid;
+		++m_tail;
+		__atomic_store_n(&m_bufs->tail, m_tail, __ATOMIC_RELEASE);
+	}
+
+	connection::connection(worker& owner, int fd)
+		: m_worker { owner }
+		, m_fd { fd }
+		, m_local { owner.m_service.m_host, port_of(fd) }
+		, m_remote { peer_of(fd) }
+	{
+		LOG_DBG2() << "uring::connection::connection(this:" << this << ", fd:" << fd << ")";
+	}
+
+	connection::~connection()
+	{
+		LOG_DBG2() << "uring::connection::~connection(this:" << this << ")";
+		release_buffers();
+		::close(m_fd);
+	}
+
+	void connection::start(asio::stack_pool& stacks)
+	{
+		m_fiber = boost::context::fiber { std::allocator_arg, stacks.get_allocator(), [this](boost::context::fiber&& caller) {
+			m_caller = std::move(caller);
+			LOG_DBG2() << "START =============================================";
+			{
+				stream io { *this };
+				m_worker.m_service.m_callbacks.on_connection(io, false);
+			}
+			LOG_DBG2() << "STOP ----------------------------------------------";
+			m_done = true;
+			return std::move(m_caller);
+		} };
+		resume();
+	}
+
+	void connection::arm_recv()
+	{
+		auto sqe = m_worker.m_ring.next_sqe();
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = m_fd;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = buffer_ring::group;
+		sqe->user_data = worker::user_data(this, worker::recv_tag);
+		m_recv_armed = true;
+	}
+
+	void connection::on_recv(const io_uring_cqe& cqe)
+	{
+		m_recv_armed = false;
+
+		if (cqe.flags & IORING_CQE_F_BUFFER) {
+			auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+			m_worker.m_buffers.taken();
+			if (cqe.res > 0)
+				m_received.push_back({ bid, 0, static_cast<uint32_t>(cqe.res) });
+			else
+				m_worker.m_buffers.recycle(bid);
+		}
+
+		if (cqe.res == -ENOBUFS) // re-armed by the worker, once buffers come back
+			return;
+
+		if (cqe.res > 0)
+			received();
+		else
+			m_recv_ended = true;
+
+		if (m_reading)
+			resume();
+	}
+
+	void connection::on_send(const io_uring_cqe& cqe)
+	{
+		m_send_result = cqe.res;
+		m_sending = false;
+		resume();
+	}
+
+	void connection::release_buffers()
+	{
+		for (auto const& item : m_received)
+			m_worker.m_buffers.recycle(item.bid);
+		m_received.clear();
+	}
+
+	void connection::abort()
+	{
+		m_deadline = { };
+		m_recv_ended = true;
+		release_buffers();
+		::shutdown(m_fd, SHUT_RDWR);
+
+		// with no recv armed, e.g. starved, nothing else would wake it up
+		if (m_reading)
+			resume();
+	}
+
+	bool connection::expired(asio::timer_wheel::clock::time_point now) const
+	{
+		return m_deadline != asio::timer_wheel::clock::time_point { } && m_deadline <= now;
+	}
+
+	void connection::arm(std::chrono::milliseconds timeout)
+	{
+		if (timeout.count() > 0)
+			m_deadline = asio::timer_wheel::clock::now() + timeout;
+		else
+			m_deadline = { };
+	}
+
+	void connection::stage(stream*, io_stage next)
+	{
+		m_stage = next;
+		auto& limits = m_worker.m_service.m_timeouts;
+		switch (next) {
+		case io_stage::idle: arm(limits.idle); break;
+		case io_stage::head: arm(limits.head); break;
+		case io_stage::body: arm(limits.body); break;
+		case io_stage::reply: arm({ }); break;
+		}
+	}
+
+	void connection::received()
+	{
+		if (m_stage == io_stage::idle)
+			stage(nullptr, io_stage::head);
+		else if (m_stage == io_stage::body)
+			stage(nullptr, io_stage::body);
+	}
+
+	void connection::writing()
+	{
+		arm(m_worker.m_service.m_timeouts.write);
+	}
+
+	void connection::written()
+	{
+		if (m_stage != io_stage::head)
+			stage(nullptr, m_stage);
+	}
+
+	void connection::shutdown(stream* src)
+	{
+		LOG_DBG2() << "uring::connection::shutdown(this:" << this << ", src:" << src << ")";
+		m_shut = true;
+		::shutdown(m_fd, SHUT_RDWR);
+	}
+
+	bool connection::overflow(stream* src, const void* data, size_t size, unsigned conn)
+	{
+		buffer_view buffer { data, size };
+		return writev(src, &buffer, 1, conn);
+	}
+
+	size_t connection::read_some(stream* src, void* data, size_t size, unsigned)
+	{
+		while (m_received.empty()) {
+			if (m_recv_ended || m_shut)
+				return 0;
+			if (!m_recv_armed)
+				arm_recv();
+
+			LOG_DBG2() << "uring::connection::read_some(this:" << this << ", src:" << src << ") -- waiting";
+			m_reading = true;
+			yield();
+			m_reading = false;
+		}
+
+		auto out = static_cast<char*>(data);
+		size_t copied = 0;
+		while (size && !m_received.empty()) {
+			auto& front = m_received.front();
+			auto chunk = std::min<size_t>(size, front.length);
+			std::memcpy(out, m_worker.m_buffers.data(front.bid) + front.offset, chunk);
+			out += chunk;
+			copied += chunk;
+			size -= chunk;
+			front.offset += static_cast<uint32_t>(chunk);
+			front.length -= static_cast<uint32_t>(chunk);
+			if (!front.length) {
+				m_worker.m_buffers.recycle(front.bid);
+				m_received.pop_front();
+			}
+		}
+		return copied;
+	}
+
+	bool connection::writev(stream* src, const buffer_view* buffers, size_t count, unsigned conn)
+	{
+		std::vector<iovec> iov;
+		iov.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			if (buffers[i].size)
+				iov.push_back({ const_cast<void*>(buffers[i].data), buffers[i].size });
+		}
+
+		writing();
+		size_t first = 0;
+		while (first < iov.size()) {
+			msghdr msg { };
+			msg.msg_iov = iov.data() + first;
+			msg.msg_iovlen = iov.size() - first;
+
+			auto sqe = m_worker.m_ring.next_sqe();
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = m_fd;
+			sqe->addr = reinterpret_cast<uint64_t>(&msg);
+			sqe->len = 1;
+			sqe->msg_flags = MSG_NOSIGNAL;
+			sqe->user_data = worker::user_data(this, worker::send_tag);
+
+			m_sending = true;
+			yield();
+
+			if (m_send_result <= 0) {
+				LOG_DBG2() << "uring::connection::writev(this:" << this << ", src:" << src << ", #" << conn << ") -- failed: " << -m_send_result;
+				return false;
+			}
+
+			auto sent = static_cast<size_t>(m_send_result);
+			while (sent && first < iov.size()) {
+				auto& item = iov[first];
+				if (sent < item.iov_len) {
+					item.iov_base = static_cast<char*>(item.iov_base) + sent;
+					item.iov_len -= sent;
+					break;
+				}
+				sent -= item.iov_len;
+				++first;
+			}
+			writing();
+		}
+
+		written();
+		src->flushed_write();
+		return true;
+	}
+
+	worker::worker(service& owner, size_t stack_size)
+		: m_service { owner }
+		, m_ring { ring_entries }
+		, m_buffers { m_ring, buffer_count, buffer_size }
+		, m_stacks { stack_size }
+	{
+		m_tick.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(asio::timer_wheel::resolution).count();
+	}
+
+	worker::~worker()
+	{
+		m_connections.clear();
+		if (m_listener >= 0)
+			::close(m_listener);
+	}
+
+	uint64_t worker::user_data(const void* ptr, tag kind)
+	{
+		return reinterpret_cast<uint64_t>(ptr) | kind;
+	}
+
+	unsigned short worker::listen(unsigned short port)
+	{
+		m_listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (m_listener < 0)
+			throw_errno("socket");
+
+		int on = 1;
+		setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		setsockopt(m_listener, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+		sockaddr_in addr { };
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		if (bind(m_listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)))
+			throw_errno("bind");
+		if (::listen(m_listener, SOMAXCONN))
+			throw_errno("listen");
+
+		return port_of(m_listener);
+	}
+
+	void worker::arm_accept()
+	{
+		auto sqe = m_ring.next_sqe();
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->fd = m_listener;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+		sqe->accept_flags = SOCK_CLOEXEC;
+		sqe->user_data = user_data(this, accept_tag);
+		m_accept_armed = true;
+	}
+
+	void worker::arm_tick()
+	{
+		auto sqe = m_ring.next_sqe();
+		sqe->opcode = IORING_OP_TIMEOUT;
+		sqe->addr = reinterpret_cast<uint64_t>(&m_tick);
+		sqe->len = 1;
+		sqe->user_data = user_data(this, tick_tag);
+	}
+
+	void worker::run()
+	{
+		arm_accept();
+		arm_tick();
+
+		while (!m_closing || !m_connections.empty()) {
+			m_ring.submit(1);
+			m_ring.drain([this](const io_uring_cqe& cqe) { dispatch(cqe); });
+
+			// a starved recv, re-armed too early, comes back here
+			if (!m_starved.empty() && m_buffers.available()) {
+				auto starved = std::move(m_starved);
+				m_starved.clear();
+				for (auto conn : starved) {
+					if (m_connections.count(conn) && conn->starved())
+						conn->rearm();
+				}
+			}
+		}
+	}
+
+	void worker::dispatch(const io_uring_cqe& cqe)
+	{
+		auto const kind = static_cast<tag>(cqe.user_data & tag_mask);
+		auto const ptr = cqe.user_data & ~tag_mask;
+		switch (kind) {
+		case accept_tag:
+			on_accept(cqe);
+			break;
+		case tick_tag:
+			on_tick();
+			break;
+		case recv_tag: {
+			auto conn = reinterpret_cast<connection*>(ptr);
+			conn->on_recv(cqe);
+			if (conn->starved())
+				m_starved.push_back(conn);
+			if (conn->done())
+				finish(conn);
+			break;
+		}
+		case send_tag: {
+			auto conn = reinterpret_cast<connection*>(ptr);
+			conn->on_send(cqe);
+			if (conn->done())
+				finish(conn);
+			break;
+		}
+		case ignore_tag:
+			break;
+		}
+	}
+
+	void worker::on_accept(const io_uring_cqe& cqe)
+	{
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			m_accept_armed = false;
+
+		if (cqe.res < 0) {
+			if (!m_closing)
+				LOG_ERR() << "uring::worker::on_accept(this:" << this << ") -- acceptor error: " << std::strerror(-cqe.res);
+			return; // re-armed by the next tick
+		}
+
+		if (m_closing) {
+			::close(cqe.res);
+			return;
+		}
+
+		if (!m_accept_armed)
+			arm_accept();
+
+		auto conn = std::make_unique<connection>(*this, cqe.res);
+		auto ptr = conn.get();
+		m_connections.emplace(ptr, std::move(conn));
+		++m_open;
+		++m_accepted;
+
+		ptr->start(m_stacks);
+		if (ptr->done())
+			finish(ptr);
+	}
+
+	void worker::on_tick()
+	{
+		if (m_service.m_stopping && !m_closing)
+			close_all();
+
+		if (!m_closing && !m_accept_armed)
+			arm_accept();
+
+		// a scan instead of a wheel: every connection of the ring is
+		// owned by this thread, and the check is a single comparison
+		auto now = asio::timer_wheel::clock::now();
+		std::vector<connection*> expired;
+		for (auto& [ptr, conn] : m_connections) {
+			if (conn->expired(now))
+				expired.push_back(ptr);
+		}
+		for (auto conn : expired) {
+			LOG_DBG2() << "uring::worker::on_tick(this:" << this << ") -- expired " << conn;
+			++m_timed_out;
+			abort(conn);
+		}
+
+		arm_tick();
+	}
+
+	void worker::abort(connection* conn)
+	{
+		// the coroutine may run to its end, which erases the connection
+		conn->abort();
+		if (conn->done())
+			finish(conn);
+	}
+
+	void worker::finish(connection* conn)
+	{
+		if (conn->recv_armed()) {
+			// the last completion of the recv comes back here
+			conn->abort();
+			auto sqe = m_ring.next_sqe();
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = user_data(conn, recv_tag);
+			sqe->user_data = user_data(this, ignore_tag);
+			return;
+		}
+
+		m_connections.erase(conn);
+		--m_open;
+	}
+
+	void worker::close_all()
+	{
+		LOG_DBG2() << "uring::worker::close_all(this:" << this << ")";
+		m_closing = true;
+		if (m_accept_armed) {
+			auto sqe = m_ring.next_sqe();
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->addr = user_data(this, accept_tag);
+			sqe->user_data = user_data(this, ignore_tag);
+		}
+		std::vector<connection*> open;
+		open.reserve(m_connections.size());
+		for (auto& [ptr, conn] : m_connections)
+			open.push_back(ptr);
+		for (auto conn : open)
+			abort(conn);
+	}
+
+	namespace {
+		std::atomic<service*> signalled { nullptr };
+
+		extern "C" void on_signal(int)
+		{
+			if (auto svc = signalled.load())
+				svc->stop();
+		}
+	}
+
+	service::service(const asio::callbacks& cb, size_t threads, size_t stack_size, const asio::timeouts& limits)
+		: m_callbacks { cb }
+		, m_timeouts { limits }
+		, m_threads { threads ? threads : 1 }
+		, m_stack_size { stack_size ? stack_size : 256 * 1024 }
+	{
+		LOG_DBG2() << "uring::service::service(this:" << this << ")";
+	}
+
+	service::~service()
+	{
+		LOG_DBG2() << "uring::service::~service(this:" << this << ")";
+	}
+
+	asio::endpoint service::setup(unsigned short port)
+	{
+		LOG_DBG2() << "uring::service::setup(this:" << this << ", port:" << port << ")";
+		m_host = boost::asio::ip::host_name();
+
+		m_workers.clear();
+		m_workers.reserve(m_threads);
+		for (size_t i = 0; i < m_threads; ++i) {
+			m_workers.push_back(std::make_unique<worker>(*this, m_stack_size));
+			// all workers must agree on a port, even if the first one was given 0
+			port = m_workers.back()->listen(port);
+		}
+
+		return { m_host, port };
+	}
+
+	void service::run()
+	{
+		if (m_workers.empty())
+			return;
+
+		m_stopping = false;
+		signalled = this;
+		struct sigaction action { };
+		action.sa_handler = on_signal;
+		sigemptyset(&action.sa_mask);
+		struct sigaction previous[3] { };
+		sigaction(SIGINT, &action, &previous[0]);
+		sigaction(SIGTERM, &action, &previous[1]);
+		sigaction(SIGQUIT, &action, &previous[2]);
+
+		auto run_worker = [this](worker& item) {
+			try {
+				item.run();
+			} catch (std::exception& e) {
+				LOG_ERR() << "uring::service::run(this:" << this << ") -- " << e.what();
+				stop();
+			}
+		};
+
+		std::vector<std::thread> pool;
+		pool.reserve(m_workers.size() - 1);
+		for (size_t i = 1; i < m_workers.size(); ++i)
+			pool.emplace_back([&, ptr = m_workers[i].get()] { run_worker(*ptr); });
+		run_worker(*m_workers.front());
+
+		for (auto& th : pool)
+			th.join();
+
+		sigaction(SIGINT, &previous[0], nullptr);
+		sigaction(SIGTERM, &previous[1], nullptr);
+		sigaction(SIGQUIT, &previous[2], nullptr);
+		signalled = nullptr;
+	}
+
+	std::vector<asio::shard_stats> service::stats() const
+	{
+		std::vector<asio::shard_stats> out;
+		out.reserve(m_workers.size());
+		for (auto& item : m_workers)
+			out.push_back(item->stats());
+		return out;
+	}
+}} // web::uring